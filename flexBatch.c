@@ -0,0 +1,350 @@
+#include "flexBatch.h"
+#include <stdlib.h>
+
+/*
+ * Sizes that layoutFlex keeps as ints are stored as floats, truncated the same
+ * way, so that the trees lay out exactly as they would one at a time.
+ */
+
+/** The number of per-tree values in the frame of a container, besides the bases of its children. */
+#define FRAME_VALUES 9
+
+static enum FlexDirection getPerpendicularAxis(enum FlexDirection axis) {
+	return axis == DIRECTION_ROW ? DIRECTION_COLUMN : DIRECTION_ROW;
+}
+
+static float getLeadingMargin(const struct FlexParams *params, enum FlexDirection axis) {
+	return axis == DIRECTION_ROW ? params->marginLeft : params->marginTop;
+}
+
+static float getMargin(const struct FlexParams *params, enum FlexDirection axis) {
+	return axis == DIRECTION_ROW ? params->marginLeft + params->marginRight : params->marginTop + params->marginBottom;
+}
+
+static float getStyleSize(const struct FlexParams *params, enum FlexDirection axis) {
+	return axis == DIRECTION_ROW ? params->width : params->height;
+}
+
+static float getFlexGrowFactor(const struct FlexParams *params) {
+	return params->flex > 0 ? params->flex : 0;
+}
+
+static int getFlexShrinkFactor(const struct FlexParams *params) {
+	return params->flex < 0;
+}
+
+/** Returns the per-tree values of the specified node in an array. */
+static float *getValues(const struct FlexBatch *batch, float *array, int node) {
+	return array + (size_t) node * batch->treeCount;
+}
+
+static float *getLayoutSizes(const struct FlexBatch *batch, int node, enum FlexDirection axis) {
+	return getValues(batch, axis == DIRECTION_ROW ? batch->width : batch->height, node);
+}
+
+static float *getPositions(const struct FlexBatch *batch, int node, enum FlexDirection axis) {
+	return getValues(batch, axis == DIRECTION_ROW ? batch->x : batch->y, node);
+}
+
+static void fill(float *values, int count, float value) {
+	for (int t = 0; t < count; ++t) values[t] = value;
+}
+
+/** Returns the scratch storage needed to lay out the subtree, in per-tree values. */
+static size_t getScratchSize(const struct FlexBatch *batch, int index) {
+	const struct FlexBatchNode *node = batch->nodes + index;
+	if (node->leaf) return 0;
+	size_t childSize = 0;
+	for (int i = 0; i < node->childCount; ++i) {
+		size_t size = getScratchSize(batch, batch->children[node->children + i]);
+		if (size > childSize) childSize = size;
+	}
+	return node->childCount + FRAME_VALUES + childSize;
+}
+
+static int copyShape(struct FlexBatch *batch, const struct FlexNode *shape, int *childOffset) {
+	int index = batch->nodeCount++;
+	struct FlexBatchNode *node = batch->nodes + index;
+	node->params = shape->params;
+	node->direction = shape->direction;
+	node->justify = shape->justify;
+	node->leaf = !!shape->measure;
+	node->childCount = node->leaf ? 0 : shape->childCount;
+	node->children = *childOffset;
+	*childOffset += node->childCount;
+	for (int i = 0; i < node->childCount; ++i) batch->children[node->children + i] = copyShape(batch, shape->children[i], childOffset);
+	return index;
+}
+
+static int countNodes(const struct FlexNode *shape) {
+	int count = 1;
+	if (!shape->measure) {
+		for (int i = 0; i < shape->childCount; ++i) count += countNodes(shape->children[i]);
+	}
+	return count;
+}
+
+int flexBatchInit(struct FlexBatch *batch, const struct FlexNode *shape, int treeCount) {
+	int nodeCount = countNodes(shape), childOffset = 0;
+	size_t values = (size_t) nodeCount * treeCount;
+	batch->nodeCount = 0;
+	batch->treeCount = treeCount;
+	batch->nodes = malloc(nodeCount * sizeof *batch->nodes);
+	batch->children = malloc(nodeCount * sizeof *batch->children);
+	batch->contentWidth = calloc(6 * values, sizeof *batch->contentWidth);
+	batch->scratch = NULL;
+	if (!batch->nodes || !batch->children || !batch->contentWidth) {
+		flexBatchDestroy(batch);
+		return 0;
+	}
+	batch->contentHeight = batch->contentWidth + values;
+	batch->x = batch->contentHeight + values;
+	batch->y = batch->x + values;
+	batch->width = batch->y + values;
+	batch->height = batch->width + values;
+	copyShape(batch, shape, &childOffset);
+
+	size_t scratchSize = getScratchSize(batch, 0) * treeCount;
+	if (scratchSize && !(batch->scratch = malloc(scratchSize * sizeof *batch->scratch))) {
+		flexBatchDestroy(batch);
+		return 0;
+	}
+	return 1;
+}
+
+void flexBatchDestroy(struct FlexBatch *batch) {
+	free(batch->nodes);
+	free(batch->children);
+	free(batch->contentWidth);
+	free(batch->scratch);
+	batch->nodes = NULL;
+	batch->children = NULL;
+	batch->contentWidth = batch->contentHeight = batch->x = batch->y = batch->width = batch->height = batch->scratch = NULL;
+	batch->nodeCount = 0;
+}
+
+/** Sizes the leaves of the trees to their content, as clamped by the constraints. */
+static void measureLeaf(const float *restrict available, enum MeasureMode mode, const float *restrict content, float *restrict size, int treeCount) {
+	switch (mode) {
+		case MEASURE_EXACTLY:
+			for (int t = 0; t < treeCount; ++t) size[t] = available[t];
+			break;
+		case MEASURE_AT_MOST:
+			for (int t = 0; t < treeCount; ++t) size[t] = content[t] > available[t] ? available[t] : content[t];
+			break;
+		default:
+			for (int t = 0; t < treeCount; ++t) size[t] = content[t];
+			break;
+	}
+}
+
+/**
+ * Lays out the subtree of the specified node in all trees, as #layoutFlex.
+ *
+ * The branches of #layoutFlex on the constraints are taken for all trees at
+ * once, as the measure modes are the same; those on the sizes become selects.
+ */
+static void layoutNode(const struct FlexBatch *batch, int index, const float *width, enum MeasureMode widthMode, const float *height, enum MeasureMode heightMode, float *scratch) {
+	const struct FlexBatchNode *node = batch->nodes + index;
+	int n = batch->treeCount;
+	float *restrict nodeWidth = getValues(batch, batch->width, index), *restrict nodeHeight = getValues(batch, batch->height, index);
+	if (node->leaf) {
+		measureLeaf(width, widthMode, getValues(batch, batch->contentWidth, index), nodeWidth, n);
+		measureLeaf(height, heightMode, getValues(batch, batch->contentHeight, index), nodeHeight, n);
+		return;
+	}
+
+	enum FlexDirection mainAxis = node->direction, crossAxis = getPerpendicularAxis(mainAxis);
+	const int *children = batch->children + node->children;
+	int childCount = node->childCount;
+	enum MeasureMode mainMeasureMode = mainAxis == DIRECTION_ROW ? widthMode : heightMode,
+					 crossMeasureMode = crossAxis == DIRECTION_ROW ? widthMode : heightMode;
+	const float *restrict availableMain = mainAxis == DIRECTION_ROW ? width : height,
+		  *restrict availableCross = crossAxis == DIRECTION_ROW ? width : height;
+	float *restrict childWidth = scratch, *restrict childHeight = childWidth + n,
+		  *restrict sizeConsumed = childHeight + n, *restrict totalFlexShrinkScaledFactors = sizeConsumed + n,
+		  *restrict remainingSpace = totalFlexShrinkScaledFactors + n, *restrict leadingMainSize = remainingSpace + n,
+		  *restrict betweenMain = leadingMainSize + n, *restrict mainSize = betweenMain + n, *restrict crossSize = mainSize + n,
+		  *bases = crossSize + n, *childScratch = bases + (size_t) childCount * n;
+
+	// Determine basis for each child
+	float totalFlexGrowFactors = 0; // The same for all trees
+	fill(sizeConsumed, n, 0);
+	fill(totalFlexShrinkScaledFactors, n, 0);
+	for (int i = 0; i < childCount; ++i) {
+		const struct FlexParams *params = &batch->nodes[children[i]].params;
+		float *restrict basis = bases + (size_t) i * n;
+
+		if (!isUndefined(getStyleSize(params, mainAxis))) {
+			fill(basis, n, getStyleSize(params, mainAxis));
+		} else {
+			// A child with a flex basis has none in the trees without available space
+			int isBasisAuto = params->flex <= 0, measure = isBasisAuto;
+			for (int t = 0; t < n && !measure; ++t) measure = !availableMain[t];
+			if (measure) {
+				// Determine the base size by performing layout
+				const float *w = width, *h = height;
+				enum MeasureMode childWidthMode, childHeightMode;
+
+				if (!isUndefined(params->width)) {
+					fill(childWidth, n, params->width);
+					w = childWidth;
+					childWidthMode = MEASURE_EXACTLY;
+				} else if (crossAxis == DIRECTION_ROW && widthMode == MEASURE_EXACTLY && params->align == ALIGN_STRETCH) {
+					childWidthMode = MEASURE_EXACTLY;
+				} else {
+					childWidthMode = widthMode == MEASURE_UNSPECIFIED ? MEASURE_UNSPECIFIED : MEASURE_AT_MOST;
+				}
+
+				if (!isUndefined(params->height)) {
+					fill(childHeight, n, params->height);
+					h = childHeight;
+					childHeightMode = MEASURE_EXACTLY;
+				} else if (crossAxis == DIRECTION_COLUMN && heightMode == MEASURE_EXACTLY && params->align == ALIGN_STRETCH) {
+					childHeightMode = MEASURE_EXACTLY;
+				} else {
+					childHeightMode = heightMode == MEASURE_UNSPECIFIED ? MEASURE_UNSPECIFIED : MEASURE_AT_MOST;
+				}
+
+				layoutNode(batch, children[i], w, childWidthMode, h, childHeightMode, childScratch);
+				const float *restrict size = getLayoutSizes(batch, children[i], mainAxis);
+				for (int t = 0; t < n; ++t) basis[t] = isBasisAuto || !availableMain[t] ? size[t] : 0;
+			} else {
+				fill(basis, n, 0);
+			}
+		}
+
+		float margin = getMargin(params, mainAxis);
+		int flexShrinkFactor = getFlexShrinkFactor(params);
+		for (int t = 0; t < n; ++t) {
+			sizeConsumed[t] += basis[t] + margin;
+			totalFlexShrinkScaledFactors[t] += flexShrinkFactor * basis[t];
+		}
+		totalFlexGrowFactors += getFlexGrowFactor(params);
+	}
+
+	// Layout flexible children and allocate empty space
+	int allocate = totalFlexGrowFactors == 0 && mainMeasureMode == MEASURE_EXACTLY;
+	for (int t = 0; t < n; ++t) {
+		float remaining = remainingSpace[t] = availableMain[t] ? availableMain[t] - sizeConsumed[t] : 0;
+		float leading = 0, between = 0;
+		if (allocate && remaining > 0) {
+			// Allocate remaining space according to justify.
+			switch (node->justify) {
+				default:
+				case ALIGN_START:
+					break;
+				case ALIGN_CENTER:
+					leading = remaining / 2;
+					break;
+				case ALIGN_END:
+					leading = remaining;
+					break;
+				case ALIGN_SPACE_BETWEEN:
+					if (childCount > 1) between = remaining / (childCount - 1);
+					break;
+				case ALIGN_SPACE_AROUND:
+					leading = (between = remaining / childCount) / 2;
+					break;
+			}
+		}
+		leadingMainSize[t] = leading;
+		betweenMain[t] = between;
+		mainSize[t] = (int) leading;
+		crossSize[t] = 0;
+	}
+	for (int i = 0; i < childCount; ++i) {
+		const struct FlexParams *params = &batch->nodes[children[i]].params;
+		float *restrict childBasis = bases + (size_t) i * n;
+		int flexShrinkFactor = getFlexShrinkFactor(params);
+		float flexGrowFactor = getFlexGrowFactor(params);
+		for (int t = 0; t < n; ++t) {
+			float basis = childBasis[t], remaining = remainingSpace[t], flexShrinkScaledFactor = flexShrinkFactor * basis;
+			if (remaining < 0) {
+				if (flexShrinkScaledFactor != 0) basis += remaining / totalFlexShrinkScaledFactors[t] * flexShrinkScaledFactor;
+			} else if (remaining > 0) {
+				if (flexGrowFactor != 0) basis += remaining / totalFlexGrowFactors * flexGrowFactor;
+			}
+			childBasis[t] = basis;
+		}
+
+		int hasCrossStyleSize = !isUndefined(getStyleSize(params, crossAxis));
+		const float *childCrossSize = availableCross;
+		if (hasCrossStyleSize) {
+			fill(childWidth, n, getStyleSize(params, crossAxis));
+			childCrossSize = childWidth;
+		}
+		enum MeasureMode childCrossMode = hasCrossStyleSize || (crossMeasureMode == MEASURE_EXACTLY && params->align == ALIGN_STRETCH)
+			? MEASURE_EXACTLY : crossMeasureMode == MEASURE_UNSPECIFIED ? MEASURE_UNSPECIFIED : MEASURE_AT_MOST;
+		if (mainAxis == DIRECTION_ROW) {
+			layoutNode(batch, children[i], childBasis, MEASURE_EXACTLY, childCrossSize, childCrossMode, childScratch);
+		} else {
+			layoutNode(batch, children[i], childCrossSize, childCrossMode, childBasis, MEASURE_EXACTLY, childScratch);
+		}
+
+		// Position element in the main axis
+		float *restrict position = getPositions(batch, children[i], mainAxis);
+		const float *restrict mainChildSize = getLayoutSizes(batch, children[i], mainAxis),
+			  *restrict crossChildSize = getLayoutSizes(batch, children[i], crossAxis);
+		float leadingMargin = getLeadingMargin(params, mainAxis), mainMargin = getMargin(params, mainAxis), crossMargin = getMargin(params, crossAxis);
+		for (int t = 0; t < n; ++t) {
+			position[t] = mainSize[t] + leadingMargin;
+			mainSize[t] = (int) (mainSize[t] + (betweenMain[t] + mainChildSize[t] + mainMargin));
+			float childCross = crossChildSize[t] + crossMargin;
+			crossSize[t] = (int) (crossSize[t] > childCross ? crossSize[t] : childCross);
+		}
+	}
+
+	// If the dimensions are definite: set them
+	if (mainMeasureMode == MEASURE_EXACTLY) {
+		for (int t = 0; t < n; ++t) mainSize[t] = (int) availableMain[t];
+	}
+	if (crossMeasureMode == MEASURE_EXACTLY) {
+		for (int t = 0; t < n; ++t) crossSize[t] = (int) availableCross[t];
+	}
+
+	// Position elements in the cross axis
+	for (int i = 0; i < childCount; ++i) {
+		const struct FlexParams *params = &batch->nodes[children[i]].params;
+		float *restrict position = getPositions(batch, children[i], crossAxis);
+		const float *restrict size = getLayoutSizes(batch, children[i], crossAxis);
+		float leadingMargin = getLeadingMargin(params, crossAxis), margin = getMargin(params, crossAxis);
+		switch (params->align) {
+			case ALIGN_STRETCH:
+				// Layout the child if the cross size wasn't already definite
+				if (!getStyleSize(params, crossAxis)) {
+					float *restrict crossChildSize = crossAxis == DIRECTION_ROW ? childWidth : childHeight,
+						  *restrict mainChildSize = crossAxis == DIRECTION_ROW ? childHeight : childWidth;
+					const float *restrict currentMainSize = getLayoutSizes(batch, children[i], mainAxis);
+					for (int t = 0; t < n; ++t) {
+						crossChildSize[t] = crossSize[t] - margin;
+						mainChildSize[t] = currentMainSize[t];
+					}
+					layoutNode(batch, children[i], childWidth, MEASURE_EXACTLY, childHeight, MEASURE_EXACTLY, childScratch);
+				}
+				fill(position, n, leadingMargin);
+				break;
+			case ALIGN_CENTER:
+			case ALIGN_END: {
+				float divisor = params->align == ALIGN_CENTER ? 2 : 1;
+				for (int t = 0; t < n; ++t) position[t] = (int) ((crossSize[t] - size[t] - margin) / divisor) + leadingMargin;
+				break;
+			}
+			default:
+				fill(position, n, leadingMargin);
+				break;
+		}
+	}
+
+	// Set the implicit width and height
+	for (int t = 0; t < n; ++t) {
+		nodeWidth[t] = mainAxis == DIRECTION_ROW ? mainSize[t] : crossSize[t];
+		nodeHeight[t] = mainAxis == DIRECTION_ROW ? crossSize[t] : mainSize[t];
+	}
+}
+
+void flexBatchLayout(struct FlexBatch *batch, const float *width, enum MeasureMode widthMode, const float *height, enum MeasureMode heightMode) {
+	fill(batch->x, batch->treeCount, 0);
+	fill(batch->y, batch->treeCount, 0);
+	layoutNode(batch, 0, width, widthMode, height, heightMode, batch->scratch);
+}
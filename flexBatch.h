@@ -0,0 +1,106 @@
+/**
+ * Lays out many trees of the same shape in lockstep.
+ *
+ * Scenes such as world-space nameplates hold thousands of small trees with
+ * the same structure and parameters, differing only in the size of their
+ * content. Laying them out one by one repeats the same control flow for
+ * every tree, while the few children of each container leave nothing to
+ * vectorize. A batch instead stores each computed value of a node for all
+ * trees side by side, and runs #layoutFlex's algorithm once per node, with
+ * the arithmetic in loops over the trees that the compiler may vectorize.
+ *
+ * The shape is copied from a #FlexNode tree, whose nodes are numbered in
+ * preorder, the root being \c 0. Its leaves, the nodes with a
+ * FlexNode#measure, size to their content as set per tree in
+ * FlexBatch#contentWidth and FlexBatch#contentHeight: to the available size
+ * if exact, clamped to it if at most, and as is otherwise. The layout is the
+ * same as laying out each tree with #flexNodeLayout, given leaves measuring
+ * that way.
+ * @file
+ */
+#ifndef FLEX_BATCH_H
+#define FLEX_BATCH_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+#include "flexNode.h"
+
+/** A node of the shape of a #FlexBatch. */
+struct FlexBatchNode {
+	/** The layout parameters of the node. */
+	struct FlexParams params;
+	/** The direction the children are placed in. */
+	enum FlexDirection direction;
+	/** The alignment of the children in the main axis. */
+	enum Align justify;
+	/** Whether the node is a leaf sized to its content. */
+	int leaf;
+	/** The offset of the indices of the children in FlexBatch#children. */
+	int children;
+	/** The number of children. */
+	int childCount;
+};
+
+/**
+ * Trees of the same shape laid out together.
+ *
+ * The per-tree values of node \c i and tree \c t are at index
+ * <code>i * treeCount + t</code> of the arrays.
+ */
+struct FlexBatch {
+	/** The nodes of the shape, in preorder. */
+	struct FlexBatchNode *nodes;
+	/** The number of nodes of the shape. */
+	int nodeCount;
+	/** The indices of the children of the nodes. */
+	int *children;
+	/** The number of trees. */
+	int treeCount;
+	/** The size of the content of the leaves, set by the application. */
+	float *contentWidth, *contentHeight;
+	/** The computed coordinates relative to the parent; \c 0 for the root. */
+	float *x, *y;
+	/** The computed sizes. */
+	float *width, *height;
+	/** Storage for the intermediate values of the containers being laid out. */
+	float *scratch;
+};
+
+/**
+ * Initializes the specified batch with the shape of a tree.
+ *
+ * The contents are initialized to \c 0.
+ *
+ * @param batch The batch.
+ * @param shape The root of the tree to copy the shape of.
+ * @param treeCount The number of trees.
+ * @return Whether the batch was initialized; \c 0 if out of memory.
+ */
+int flexBatchInit(struct FlexBatch *batch, const struct FlexNode *shape, int treeCount);
+
+/**
+ * Frees the storage of the specified batch.
+ *
+ * @param batch The batch.
+ */
+void flexBatchDestroy(struct FlexBatch *batch);
+
+/**
+ * Lays out the trees of the batch.
+ *
+ * @param batch The batch.
+ * @param width The available width of each tree.
+ * @param widthMode The width requirement, the same for all trees.
+ * @param height The available height of each tree.
+ * @param heightMode The height requirement, the same for all trees.
+ */
+void flexBatchLayout(struct FlexBatch *batch, const float *width, enum MeasureMode widthMode, const float *height, enum MeasureMode heightMode);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
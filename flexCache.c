@@ -0,0 +1,236 @@
+#include "flexCache.h"
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#define tryLock(lock) !_InterlockedExchange(lock, 1)
+#define releaseLock(lock) _InterlockedExchange(lock, 0)
+#define pauseProcessor() _mm_pause()
+#else
+#define tryLock(lock) !__sync_lock_test_and_set(lock, 1)
+#define releaseLock(lock) __sync_lock_release(lock)
+#if defined(__i386__) || defined(__x86_64__)
+#define pauseProcessor() __builtin_ia32_pause()
+#elif defined(__aarch64__)
+#define pauseProcessor() __asm__ __volatile__("yield")
+#else
+#define pauseProcessor() ((void) 0)
+#endif
+#endif
+#ifdef _WIN32
+#include <windows.h>
+#define yieldThread() SwitchToThread()
+#else
+#include <sched.h>
+#define yieldThread() sched_yield()
+#endif
+
+/** The number of failed attempts to take a lock before yielding the processor. */
+#define SPIN_COUNT 64
+
+/**
+ * Acquires the lock of the stripe, spinning since it is only held briefly.
+ *
+ * Pauses between attempts, so as not to starve a holder on the same core, and
+ * yields after #SPIN_COUNT of them in case the holder was preempted.
+ */
+static void lockStripe(struct FlexCacheStripe *stripe) {
+	for (int spins = 0; !tryLock(&stripe->lock);) {
+		if (++spins < SPIN_COUNT) {
+			pauseProcessor();
+		} else {
+			yieldThread();
+			spins = 0;
+		}
+	}
+}
+
+static void unlockStripe(struct FlexCacheStripe *stripe) {
+	releaseLock(&stripe->lock);
+}
+
+/** Returns the bits of the size, with equal sizes mapping to equal bits. */
+static unsigned getSizeBits(float size) {
+	unsigned bits;
+	if (isUndefined(size)) return 0x7fc00000;
+	if (size == 0) size = 0; // Fold negative zero
+	memcpy(&bits, &size, sizeof bits);
+	return bits;
+}
+
+static unsigned long long hashKey(unsigned long long hash, const struct FlexMeasurement *measurement) {
+	hash ^= (unsigned long long) getSizeBits(measurement->width) << 32 | getSizeBits(measurement->height);
+	hash ^= (unsigned long long) measurement->widthMode << 2 | measurement->heightMode;
+	hash *= 0x9E3779B97F4A7C15ULL;
+	return hash ^ hash >> 29;
+}
+
+static int isSameKey(const struct FlexCacheEntry *entry, unsigned long long hash, const struct FlexMeasurement *measurement) {
+	return entry->hash == hash && entry->measurement.widthMode == measurement->widthMode && entry->measurement.heightMode == measurement->heightMode
+		&& getSizeBits(entry->measurement.width) == getSizeBits(measurement->width) && getSizeBits(entry->measurement.height) == getSizeBits(measurement->height);
+}
+
+static void destroyStripe(struct FlexCacheStripe *stripe) {
+	free(stripe->entries);
+	free(stripe->buckets);
+}
+
+static void clearStripe(struct FlexCacheStripe *stripe) {
+	for (int i = 0; i < stripe->bucketCount; ++i) stripe->buckets[i] = -1;
+	stripe->count = 0;
+	stripe->head = stripe->tail = -1;
+}
+
+static int initStripe(struct FlexCacheStripe *stripe, int capacity) {
+	stripe->lock = 0;
+	stripe->hits = stripe->misses = 0;
+	stripe->capacity = capacity;
+	for (stripe->bucketCount = 2; stripe->bucketCount < 2 * capacity; stripe->bucketCount *= 2);
+	stripe->entries = malloc(capacity * sizeof *stripe->entries);
+	stripe->buckets = malloc(stripe->bucketCount * sizeof *stripe->buckets);
+	if (!stripe->entries || !stripe->buckets) {
+		destroyStripe(stripe);
+		return 0;
+	}
+	clearStripe(stripe);
+	return 1;
+}
+
+int flexMeasureCacheInit(struct FlexMeasureCache *cache, int capacity, int stripeCount) {
+	for (cache->stripeCount = 1; cache->stripeCount < stripeCount; cache->stripeCount *= 2);
+	if (!(cache->stripes = malloc(cache->stripeCount * sizeof *cache->stripes))) return 0;
+	for (int i = 0; i < cache->stripeCount; ++i) {
+		// Spread the capacity evenly over the stripes
+		int stripeCapacity = (capacity + cache->stripeCount - 1 - i) / cache->stripeCount;
+		if (!initStripe(cache->stripes + i, stripeCapacity > 0 ? stripeCapacity : 1)) {
+			cache->stripeCount = i;
+			flexMeasureCacheDestroy(cache);
+			return 0;
+		}
+	}
+	return 1;
+}
+
+void flexMeasureCacheDestroy(struct FlexMeasureCache *cache) {
+	for (int i = 0; i < cache->stripeCount; ++i) destroyStripe(cache->stripes + i);
+	free(cache->stripes);
+	cache->stripes = NULL;
+	cache->stripeCount = 0;
+}
+
+void flexMeasureCacheClear(struct FlexMeasureCache *cache) {
+	for (int i = 0; i < cache->stripeCount; ++i) {
+		lockStripe(cache->stripes + i);
+		clearStripe(cache->stripes + i);
+		unlockStripe(cache->stripes + i);
+	}
+}
+
+/** Returns the bucket holding the key, or the empty bucket where it would be inserted. */
+static int probe(const struct FlexCacheStripe *stripe, unsigned long long hash, const struct FlexMeasurement *measurement) {
+	int mask = stripe->bucketCount - 1;
+	for (int i = (int) (hashKey(hash, measurement) & mask);; i = (i + 1) & mask) {
+		int index = stripe->buckets[i];
+		if (index < 0 || isSameKey(stripe->entries + index, hash, measurement)) return i;
+	}
+}
+
+static void unlinkEntry(struct FlexCacheStripe *stripe, int index) {
+	struct FlexCacheEntry *entry = stripe->entries + index;
+	if (entry->previous >= 0) stripe->entries[entry->previous].next = entry->next;
+	else stripe->head = entry->next;
+	if (entry->next >= 0) stripe->entries[entry->next].previous = entry->previous;
+	else stripe->tail = entry->previous;
+}
+
+static void pushFront(struct FlexCacheStripe *stripe, int index) {
+	struct FlexCacheEntry *entry = stripe->entries + index;
+	entry->previous = -1;
+	entry->next = stripe->head;
+	if (stripe->head >= 0) stripe->entries[stripe->head].previous = index;
+	else stripe->tail = index;
+	stripe->head = index;
+}
+
+/** Empties the bucket, shifting back the following buckets of the cluster that may not stay past it. */
+static void removeBucket(struct FlexCacheStripe *stripe, int hole) {
+	int mask = stripe->bucketCount - 1;
+	for (int i = (hole + 1) & mask; stripe->buckets[i] >= 0; i = (i + 1) & mask) {
+		const struct FlexCacheEntry *entry = stripe->entries + stripe->buckets[i];
+		int home = (int) (hashKey(entry->hash, &entry->measurement) & mask);
+		if (((i - home) & mask) < ((i - hole) & mask)) continue;
+		stripe->buckets[hole] = stripe->buckets[i];
+		hole = i;
+	}
+	stripe->buckets[hole] = -1;
+}
+
+static int findInStripe(struct FlexCacheStripe *stripe, unsigned long long hash, struct FlexMeasurement *measurement) {
+	int index = stripe->buckets[probe(stripe, hash, measurement)];
+	if (index < 0 || stripe->entries[index].epoch != flexGetEpoch()) {
+		++stripe->misses;
+		return 0;
+	}
+	++stripe->hits;
+	if (index != stripe->head) {
+		unlinkEntry(stripe, index);
+		pushFront(stripe, index);
+	}
+	measurement->resultWidth = stripe->entries[index].measurement.resultWidth;
+	measurement->resultHeight = stripe->entries[index].measurement.resultHeight;
+	return 1;
+}
+
+static void storeInStripe(struct FlexCacheStripe *stripe, unsigned long long hash, const struct FlexMeasurement *measurement) {
+	int bucket = probe(stripe, hash, measurement), index = stripe->buckets[bucket];
+	if (index >= 0) {
+		unlinkEntry(stripe, index);
+	} else {
+		if (stripe->count < stripe->capacity) {
+			index = stripe->count++;
+		} else {
+			// Evict the least recently used entry
+			index = stripe->tail;
+			unlinkEntry(stripe, index);
+			const struct FlexCacheEntry *evicted = stripe->entries + index;
+			removeBucket(stripe, probe(stripe, evicted->hash, &evicted->measurement));
+			bucket = probe(stripe, hash, measurement);
+		}
+		stripe->buckets[bucket] = index;
+	}
+	stripe->entries[index].hash = hash;
+	stripe->entries[index].epoch = flexGetEpoch();
+	stripe->entries[index].measurement = *measurement;
+	pushFront(stripe, index);
+}
+
+/** Returns the stripe of the key, choosing by the bits above those choosing the bucket. */
+static struct FlexCacheStripe *getStripe(struct FlexMeasureCache *cache, unsigned long long hash, const struct FlexMeasurement *measurement) {
+	return cache->stripes + (hashKey(hash, measurement) >> 40 & (unsigned) (cache->stripeCount - 1));
+}
+
+int flexMeasureCacheFind(struct FlexMeasureCache *cache, unsigned long long hash, struct FlexMeasurement *measurement) {
+	struct FlexCacheStripe *stripe = getStripe(cache, hash, measurement);
+	lockStripe(stripe);
+	int found = findInStripe(stripe, hash, measurement);
+	unlockStripe(stripe);
+	return found;
+}
+
+void flexMeasureCacheStore(struct FlexMeasureCache *cache, unsigned long long hash, const struct FlexMeasurement *measurement) {
+	struct FlexCacheStripe *stripe = getStripe(cache, hash, measurement);
+	lockStripe(stripe);
+	storeInStripe(stripe, hash, measurement);
+	unlockStripe(stripe);
+}
+
+void flexMeasureCacheGetStats(struct FlexMeasureCache *cache, long *hits, long *misses) {
+	*hits = *misses = 0;
+	for (int i = 0; i < cache->stripeCount; ++i) {
+		lockStripe(cache->stripes + i);
+		*hits += cache->stripes[i].hits;
+		*misses += cache->stripes[i].misses;
+		unlockStripe(cache->stripes + i);
+	}
+}
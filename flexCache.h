@@ -0,0 +1,128 @@
+/**
+ * A measurement cache shared between widgets with the same content.
+ *
+ * Leaves such as text labels are often recreated with the same content, and
+ * then measure to the same size as before under the same constraints. The
+ * cache maps a content hash supplied by FlexContext#getContentHash, together
+ * with the constraints, to the measured size, evicting the least recently
+ * used entry once full.
+ *
+ * The cache may be shared by threads laying out in parallel. It is split
+ * into stripes, each with its own lock, entries and recency order, so that
+ * threads seldom contend. Eviction is therefore only approximately least
+ * recently used across the whole cache.
+ * @file
+ */
+#ifndef FLEX_CACHE_H
+#define FLEX_CACHE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "flexLayout.h"
+
+/** An entry of a #FlexMeasureCache. */
+struct FlexCacheEntry {
+	/** The content hash. */
+	unsigned long long hash;
+	/** The epoch of the measurement; it is stale if not #flexGetEpoch. */
+	long epoch;
+	/** The constraints and the measured size. */
+	struct FlexMeasurement measurement;
+	/** The index of the previous and next entry in recency order, or \c -1. */
+	int previous, next;
+};
+
+/** A part of a #FlexMeasureCache with its own lock. */
+struct FlexCacheStripe {
+	/** The lock, \c 1 if held. */
+	volatile long lock;
+	/** The entries, of which #count are in use. */
+	struct FlexCacheEntry *entries;
+	/** The maximum number of entries. */
+	int capacity;
+	/** The number of entries in use. */
+	int count;
+	/** The most and least recently used entries, or \c -1 if empty. */
+	int head, tail;
+	/** Open-addressing index of the entries, with \c -1 for empty buckets. */
+	int *buckets;
+	/** The number of buckets, a power of two. */
+	int bucketCount;
+	/** The number of lookups that found an entry. */
+	long hits;
+	/** The number of lookups that did not find an entry. */
+	long misses;
+};
+
+/** A bounded cache of measurements keyed by content. */
+struct FlexMeasureCache {
+	/** The stripes, selected by the hash of the key. */
+	struct FlexCacheStripe *stripes;
+	/** The number of stripes, a power of two. */
+	int stripeCount;
+};
+
+/**
+ * Initializes the specified cache as empty.
+ *
+ * @param cache The cache.
+ * @param capacity The maximum number of measurements to keep.
+ * @param stripeCount The number of stripes, rounded up to a power of two:
+ * \c 1 for a cache used by one thread, and a few times the number of
+ * threads otherwise.
+ * @return Whether the cache was initialized; \c 0 if out of memory.
+ */
+int flexMeasureCacheInit(struct FlexMeasureCache *cache, int capacity, int stripeCount);
+
+/**
+ * Frees the storage of the specified cache.
+ *
+ * @param cache The cache.
+ */
+void flexMeasureCacheDestroy(struct FlexMeasureCache *cache);
+
+/**
+ * Removes all entries.
+ *
+ * Entries are also invalidated by #flexInvalidateAll, without freeing them.
+ * The statistics of #flexMeasureCacheGetStats are kept.
+ *
+ * @param cache The cache.
+ */
+void flexMeasureCacheClear(struct FlexMeasureCache *cache);
+
+/**
+ * Looks up the size measured for the content under the specified constraints.
+ *
+ * @param cache The cache.
+ * @param hash The content hash.
+ * @param measurement The constraints, with the size set on success.
+ * @return Whether the measurement was found.
+ */
+int flexMeasureCacheFind(struct FlexMeasureCache *cache, unsigned long long hash, struct FlexMeasurement *measurement);
+
+/**
+ * Stores the size measured for the content under the specified constraints.
+ *
+ * @param cache The cache.
+ * @param hash The content hash.
+ * @param measurement The constraints and the measured size.
+ */
+void flexMeasureCacheStore(struct FlexMeasureCache *cache, unsigned long long hash, const struct FlexMeasurement *measurement);
+
+/**
+ * Returns the number of lookups that found and did not find a measurement since the cache was initialized.
+ *
+ * @param cache The cache.
+ * @param hits Set to the number of lookups that found a measurement.
+ * @param misses Set to the number of lookups that did not.
+ */
+void flexMeasureCacheGetStats(struct FlexMeasureCache *cache, long *hits, long *misses);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,113 @@
+#include "flexCapture.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define CAPTURE_VERSION 1
+
+static int countWidgets(const struct FlexContext *context, void *widget, int (*describe)(const void *widget, enum FlexDirection *direction, enum Align *justify)) {
+	enum FlexDirection direction;
+	enum Align justify;
+	int count = 1;
+	if (!describe(widget, &direction, &justify)) return count;
+	for (int i = 0, childCount = context->getChildCount(widget); i < childCount; ++i) {
+		count += countWidgets(context, context->getChildAt(widget, i), describe);
+	}
+	return count;
+}
+
+static void captureWidget(const struct FlexContext *context, void *widget, int (*describe)(const void *widget, enum FlexDirection *direction, enum Align *justify), FILE *file) {
+	enum FlexDirection direction = DIRECTION_ROW;
+	enum Align justify = ALIGN_START;
+	int isContainer = describe(widget, &direction, &justify), childCount = isContainer ? context->getChildCount(widget) : 0;
+	struct FlexParams *params = context->getLayoutParams(widget);
+	float intrinsicWidth = 0, intrinsicHeight = 0;
+
+	if (!isContainer) {
+		// Measure the leaf and restore its size from the last layout
+		float width = context->getWidth(widget), height = context->getHeight(widget);
+		context->layout(widget, UNDEFINED, MEASURE_UNSPECIFIED, UNDEFINED, MEASURE_UNSPECIFIED);
+		intrinsicWidth = context->getWidth(widget);
+		intrinsicHeight = context->getHeight(widget);
+		context->setWidth(widget, width);
+		context->setHeight(widget, height);
+	}
+
+	fprintf(file, "%d %d %d %d %d %.9g %.9g %.9g %.9g %.9g %.9g %.9g %.9g %.9g\n", childCount, isContainer, direction, justify,
+			params->align, params->flex, params->width, params->height,
+			params->marginTop, params->marginRight, params->marginBottom, params->marginLeft, intrinsicWidth, intrinsicHeight);
+	for (int i = 0; i < childCount; ++i) captureWidget(context, context->getChildAt(widget, i), describe, file);
+}
+
+int flexCaptureTree(const struct FlexContext *context, void *widget, float width, enum MeasureMode widthMode, float height, enum MeasureMode heightMode,
+		int (*describe)(const void *widget, enum FlexDirection *direction, enum Align *justify), FILE *file) {
+	fprintf(file, "flexcapture %d\n%.9g %d %.9g %d\n%d\n", CAPTURE_VERSION, width, widthMode, height, heightMode, countWidgets(context, widget, describe));
+	captureWidget(context, widget, describe, file);
+	return !ferror(file);
+}
+
+int flexNodeDescribe(const void *widget, enum FlexDirection *direction, enum Align *justify) {
+	const struct FlexNode *node = widget;
+	*direction = node->direction;
+	*justify = node->justify;
+	return !node->measure;
+}
+
+static void measureIntrinsic(struct FlexNode *node, float width, enum MeasureMode widthMode, float height, enum MeasureMode heightMode) {
+	const float *intrinsicSize = node->userData;
+	node->width = widthMode == MEASURE_EXACTLY || (widthMode == MEASURE_AT_MOST && intrinsicSize[0] > width) ? width : intrinsicSize[0];
+	node->height = heightMode == MEASURE_EXACTLY || (heightMode == MEASURE_AT_MOST && intrinsicSize[1] > height) ? height : intrinsicSize[1];
+}
+
+/** Reads the node at \a index and its descendants, returning the index after them or \c -1. */
+static int loadNode(struct FlexCapture *capture, int index, FILE *file) {
+	if (index >= capture->nodeCount) return -1;
+	struct FlexNode *node = capture->nodes + index;
+	float *intrinsicSize = capture->intrinsicSizes + 2 * index;
+	int childCount, isContainer, direction, justify, align;
+	flexNodeInit(node);
+	if (fscanf(file, "%d %d %d %d %d %f %f %f %f %f %f %f %f %f", &childCount, &isContainer, &direction, &justify, &align,
+				&node->params.flex, &node->params.width, &node->params.height, &node->params.marginTop, &node->params.marginRight,
+				&node->params.marginBottom, &node->params.marginLeft, &intrinsicSize[0], &intrinsicSize[1]) != 14) return -1;
+	node->params.align = align;
+	node->direction = direction;
+	node->justify = justify;
+	if (!isContainer) {
+		node->measure = measureIntrinsic;
+		node->userData = intrinsicSize;
+	}
+
+	int next = index + 1;
+	for (int i = 0; i < childCount; ++i) {
+		int child = next;
+		if ((next = loadNode(capture, child, file)) < 0) return -1;
+		if (!flexNodeInsertChild(node, capture->nodes + child, i)) return -1;
+	}
+	return next;
+}
+
+int flexCaptureLoad(struct FlexCapture *capture, FILE *file) {
+	int version, widthMode, heightMode;
+	memset(capture, 0, sizeof *capture);
+	if (fscanf(file, "flexcapture %d %f %d %f %d %d", &version, &capture->width, &widthMode, &capture->height, &heightMode, &capture->nodeCount) != 6
+			|| version != CAPTURE_VERSION || capture->nodeCount <= 0) return 0;
+	capture->widthMode = widthMode;
+	capture->heightMode = heightMode;
+
+	capture->nodes = calloc(capture->nodeCount, sizeof *capture->nodes);
+	capture->intrinsicSizes = malloc(2 * capture->nodeCount * sizeof *capture->intrinsicSizes);
+	if (!capture->nodes || !capture->intrinsicSizes || loadNode(capture, 0, file) != capture->nodeCount) {
+		flexCaptureDestroy(capture);
+		return 0;
+	}
+	capture->root = capture->nodes;
+	return 1;
+}
+
+void flexCaptureDestroy(struct FlexCapture *capture) {
+	if (capture->nodes) {
+		for (int i = 0; i < capture->nodeCount; ++i) free(capture->nodes[i].children);
+	}
+	free(capture->nodes);
+	free(capture->intrinsicSizes);
+	memset(capture, 0, sizeof *capture);
+}
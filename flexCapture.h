@@ -0,0 +1,92 @@
+/**
+ * Capture of live trees for benchmarking.
+ *
+ * Unlike a trace, which records the callbacks of one layout, a capture
+ * records the shape of a tree: the structure, the layout parameters and an
+ * intrinsic size for each leaf. Loaded captures can be laid out under any
+ * constraints, and form the corpus of the benchmark tool.
+ * @file
+ */
+#ifndef FLEX_CAPTURE_H
+#define FLEX_CAPTURE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "flexNode.h"
+#include <stdio.h>
+
+/**
+ * Writes the tree rooted at the specified widget to a file.
+ *
+ * The intrinsic size of each leaf is measured by laying it out without
+ * constraints, after which its previous size is restored.
+ *
+ * @param context The context of the tree.
+ * @param widget The root of the tree.
+ * @param width The width the root is laid out with.
+ * @param widthMode The width requirement of the root.
+ * @param height The height the root is laid out with.
+ * @param heightMode The height requirement of the root.
+ * @param describe Returns whether the specified widget is a flex container,
+ * and if so sets the direction and justify it is laid out with.
+ * @param file The file to write to.
+ * @return Whether the capture was written successfully.
+ */
+int flexCaptureTree(const struct FlexContext *context, void *widget, float width, enum MeasureMode widthMode, float height, enum MeasureMode heightMode,
+		int (*describe)(const void *widget, enum FlexDirection *direction, enum Align *justify), FILE *file);
+
+/**
+ * Returns whether the specified #FlexNode is a container, for #flexCaptureTree.
+ *
+ * @param widget The node.
+ * @param direction Set to the direction of the node.
+ * @param justify Set to the justify of the node.
+ * @return Whether the node is a container.
+ */
+int flexNodeDescribe(const void *widget, enum FlexDirection *direction, enum Align *justify);
+
+/** A tree loaded from a capture. */
+struct FlexCapture {
+	/** The root of the tree. */
+	struct FlexNode *root;
+	/** The width the root was laid out with. */
+	float width;
+	/** The width requirement of the root. */
+	enum MeasureMode widthMode;
+	/** The height the root was laid out with. */
+	float height;
+	/** The height requirement of the root. */
+	enum MeasureMode heightMode;
+	/** The nodes of the tree in preorder. */
+	struct FlexNode *nodes;
+	/** The number of nodes. */
+	int nodeCount;
+	/** The intrinsic width and height of each node, used to measure the leaves. */
+	float *intrinsicSizes;
+};
+
+/**
+ * Loads the tree in the specified capture.
+ *
+ * Leaves take their intrinsic size, limited to the available space.
+ *
+ * @param capture The capture to initialize.
+ * @param file The file containing the capture.
+ * @return Whether the capture was loaded; \c 0 if malformed or out of memory.
+ */
+int flexCaptureLoad(struct FlexCapture *capture, FILE *file);
+
+/**
+ * Frees the tree of the specified capture.
+ *
+ * @param capture The capture.
+ */
+void flexCaptureDestroy(struct FlexCapture *capture);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
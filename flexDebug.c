@@ -0,0 +1,213 @@
+#include "flexDebug.h"
+#include "flexCache.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define MAX(x, y) (((x) > (y)) ? (x) : (y))
+
+/** Returns the statistic of the widget from the specified pass, or \c 0 if not laid out then. */
+static double getStatistic(const struct FlexContext *context, void *widget, enum FlexHeatmap heatmap, long pass) {
+	struct FlexState *state = flexGetState(context, widget);
+	if (!state || state->pass != pass) return 0;
+	switch (heatmap) {
+		default:
+		case FLEX_HEATMAP_TIME:
+			return state->time;
+		case FLEX_HEATMAP_LAYOUT_CALLS:
+			return state->layoutCalls;
+		case FLEX_HEATMAP_LAYOUT_COUNT:
+			return state->layoutCount;
+	}
+}
+
+static double getMaxStatistic(const struct FlexContext *context, void *widget, enum FlexHeatmap heatmap, long pass) {
+	double max = getStatistic(context, widget, heatmap, pass);
+	for (int i = 0, childCount = context->getChildCount(widget); i < childCount; ++i) {
+		max = MAX(max, getMaxStatistic(context, context->getChildAt(widget, i), heatmap, pass));
+	}
+	return max;
+}
+
+static void dumpWidget(const struct FlexContext *context, void *widget, float x, float y, enum FlexHeatmap heatmap, long pass, double max, FILE *file) {
+	struct FlexState *state = flexGetState(context, widget);
+	double value = getStatistic(context, widget, heatmap, pass);
+	float width = context->getWidth(widget), height = context->getHeight(widget);
+
+	fprintf(file, "<rect x=\"%g\" y=\"%g\" width=\"%g\" height=\"%g\" ", x, y, width, height);
+	if (state && state->pass == pass) {
+		// Go from blue to red through the hue
+		fprintf(file, "fill=\"hsl(%d, 100%%, 50%%)\" fill-opacity=\"0.35\" stroke=\"black\" stroke-width=\"0.5\">", (int) (240 * (1 - (max > 0 ? value / max : 0))));
+		fprintf(file, "<title>nodes: %d, time: %g ms, laid out: %d, layout calls: %d</title>", state->nodeCount, 1000 * state->time, state->layoutCount, state->layoutCalls);
+	} else {
+		fprintf(file, "fill=\"none\" stroke=\"gray\" stroke-width=\"0.5\">");
+	}
+	fprintf(file, "</rect>\n");
+
+	for (int i = 0, childCount = context->getChildCount(widget); i < childCount; ++i) {
+		void *child = context->getChildAt(widget, i);
+		dumpWidget(context, child, x + context->getX(child), y + context->getY(child), heatmap, pass, max, file);
+	}
+}
+
+int flexDumpSvg(const struct FlexContext *context, void *widget, enum FlexHeatmap heatmap, FILE *file) {
+	struct FlexState *state = flexGetState(context, widget);
+	long pass = state ? state->pass : 0;
+	double max = getMaxStatistic(context, widget, heatmap, pass);
+
+	fprintf(file, "<svg xmlns=\"http://www.w3.org/2000/svg\" width=\"%g\" height=\"%g\">\n", context->getWidth(widget), context->getHeight(widget));
+	dumpWidget(context, widget, 0, 0, heatmap, pass, max, file);
+	fprintf(file, "</svg>\n");
+	return !ferror(file);
+}
+
+/** The ancestors of the widget being visited by #flexFindCascades. */
+struct AncestorStack {
+	void **widgets;
+	int size, capacity;
+};
+
+static int findCascades(const struct FlexContext *context, void *widget, int threshold, long pass, struct AncestorStack *ancestors, void (*report)(void *userData, void *widget, int layoutCount, void *const *ancestors, int depth), void *userData) {
+	struct FlexState *state = flexGetState(context, widget);
+	if (!state || state->pass != pass) return 0;
+	int count = 0, childCount = context->getChildCount(widget);
+	if (state->layoutCount > threshold) {
+		report(userData, widget, state->layoutCount, ancestors->widgets, ancestors->size);
+		++count;
+	}
+	if (!childCount) return count;
+
+	if (ancestors->size == ancestors->capacity) {
+		int capacity = ancestors->capacity ? 2 * ancestors->capacity : 16;
+		void **widgets = realloc(ancestors->widgets, capacity * sizeof *widgets);
+		if (!widgets) return -1;
+		ancestors->widgets = widgets;
+		ancestors->capacity = capacity;
+	}
+	ancestors->widgets[ancestors->size++] = widget;
+	for (int i = 0; i < childCount; ++i) {
+		int childReports = findCascades(context, context->getChildAt(widget, i), threshold, pass, ancestors, report, userData);
+		if (childReports < 0) return -1;
+		count += childReports;
+	}
+	--ancestors->size;
+	return count;
+}
+
+int flexFindCascades(const struct FlexContext *context, void *widget, int threshold, void (*report)(void *userData, void *widget, int layoutCount, void *const *ancestors, int depth), void *userData) {
+	struct FlexState *state = flexGetState(context, widget);
+	struct AncestorStack ancestors = { NULL, 0, 0 };
+	int count = findCascades(context, widget, threshold, state ? state->pass : 0, &ancestors, report, userData);
+	free(ancestors.widgets);
+	return count;
+}
+
+static int countWidgets(const struct FlexContext *context, void *widget) {
+	int count = 1;
+	for (int i = 0, childCount = context->getChildCount(widget); i < childCount; ++i) count += countWidgets(context, context->getChildAt(widget, i));
+	return count;
+}
+
+/** Stores the layout of the widget and its descendants in preorder from \a index, returning the index after them. */
+static int snapshot(const struct FlexContext *context, void *widget, float *results, int index) {
+	float *result = results + 4 * index++;
+	result[FLEX_FIELD_X] = context->getX(widget);
+	result[FLEX_FIELD_Y] = context->getY(widget);
+	result[FLEX_FIELD_WIDTH] = context->getWidth(widget);
+	result[FLEX_FIELD_HEIGHT] = context->getHeight(widget);
+	for (int i = 0, childCount = context->getChildCount(widget); i < childCount; ++i) {
+		index = snapshot(context, context->getChildAt(widget, i), results, index);
+	}
+	return index;
+}
+
+/** Returns a NaN with the specified payload, which no layout computes. */
+static float getSentinel(unsigned payload) {
+	unsigned bits = 0x7fc00000u | payload;
+	float sentinel;
+	memcpy(&sentinel, &bits, sizeof sentinel);
+	return sentinel;
+}
+
+/** Overwrites the layout of the descendants and the size of the widget, which layout must set, with the sentinel. */
+static void poison(const struct FlexContext *context, void *widget, float sentinel) {
+	context->setWidth(widget, sentinel);
+	context->setHeight(widget, sentinel);
+	for (int i = 0, childCount = context->getChildCount(widget); i < childCount; ++i) {
+		void *child = context->getChildAt(widget, i);
+		context->setX(child, sentinel);
+		context->setY(child, sentinel);
+		poison(context, child, sentinel);
+	}
+}
+
+/** Finds the first widget from \a index whose layout differs from \a results, returning the index after the subtree or \c -1. */
+static int compare(const struct FlexContext *context, void *widget, const float *results, int index, struct FlexDivergence *divergence) {
+	const float *result = results + 4 * index;
+	float actual[4] = { context->getX(widget), context->getY(widget), context->getWidth(widget), context->getHeight(widget) };
+	for (int field = 0; field < 4; ++field) {
+		// Compare the bits so that zeros of either sign and NaNs of different payloads differ
+		if (!memcmp(actual + field, result + field, sizeof *actual)) continue;
+		divergence->widget = widget;
+		divergence->index = index;
+		divergence->field = field;
+		divergence->expected = result[field];
+		divergence->actual = actual[field];
+		return -1;
+	}
+	++index;
+	for (int i = 0, childCount = context->getChildCount(widget); i < childCount && index >= 0; ++i) {
+		index = compare(context, context->getChildAt(widget, i), results, index, divergence);
+	}
+	return index;
+}
+
+/** Marks the widget and its descendants as changed, invalidating the layouts cached for them. */
+static void markTreeDirty(const struct FlexContext *context, void *widget) {
+	flexMarkDirty(context, widget, FLEX_DIRTY);
+	for (int i = 0, childCount = context->getChildCount(widget); i < childCount; ++i) markTreeDirty(context, context->getChildAt(widget, i));
+}
+
+/**
+ * Lays out the tree without the layouts cached for it, so that the context computes every result itself.
+ *
+ * Only the tree is invalidated: a FlexContext#measureCache, which other trees
+ * may share, is replaced by an empty one of the same size for the layout.
+ * @return Whether the tree was laid out; \c 0 if out of memory.
+ */
+static int layoutAnew(const struct FlexContext *context, void *widget, float width, enum MeasureMode widthMode, float height, enum MeasureMode heightMode, enum FlexDirection direction, enum Align justify) {
+	struct FlexContext privateContext = *context;
+	struct FlexMeasureCache *shared = context->measureCache, cache;
+	if (shared) {
+		int capacity = 0;
+		for (int i = 0; i < shared->stripeCount; ++i) capacity += shared->stripes[i].capacity;
+		if (!flexMeasureCacheInit(&cache, capacity, shared->stripeCount)) return 0;
+		privateContext.measureCache = &cache;
+	}
+	markTreeDirty(context, widget);
+	layoutFlex(&privateContext, widget, width, widthMode, height, heightMode, direction, justify);
+	if (shared) flexMeasureCacheDestroy(&cache);
+	return 1;
+}
+
+int flexVerifyLayout(const struct FlexContext *context, const struct FlexContext *reference, void *widget,
+		float width, enum MeasureMode widthMode, float height, enum MeasureMode heightMode,
+		enum FlexDirection direction, enum Align justify, struct FlexDivergence *divergence) {
+	float *results = malloc(4 * countWidgets(context, widget) * sizeof *results);
+	if (!results) return -1;
+	// Distinct sentinels, written with the reference setters, expose results left over from the previous layout
+	poison(reference, widget, getSentinel(1));
+	if (!layoutAnew(reference, widget, width, widthMode, height, heightMode, direction, justify)) {
+		free(results);
+		return -1;
+	}
+	snapshot(context, widget, results, 0);
+
+	poison(reference, widget, getSentinel(2));
+	if (!layoutAnew(context, widget, width, widthMode, height, heightMode, direction, justify)) {
+		free(results);
+		return -1;
+	}
+	int match = compare(context, widget, results, 0, divergence) >= 0;
+	free(results);
+	return match;
+}
@@ -0,0 +1,124 @@
+/**
+ * Tools for debugging layout performance and correctness.
+ *
+ * The performance tools rely on the statistics kept in the #FlexState of each
+ * widget and therefore require the tree to have been laid out with
+ * #FLEX_OPTION_STATS and per-widget state.
+ * @file
+ */
+#ifndef FLEX_DEBUG_H
+#define FLEX_DEBUG_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "flexLayout.h"
+#include <stdio.h>
+
+/** Statistics that a heatmap can be colored by. */
+enum FlexHeatmap {
+	/** FlexState#time, the time spent laying out the subtree. */
+	FLEX_HEATMAP_TIME,
+	/** FlexState#layoutCalls, the number of layouts of children the widget caused. */
+	FLEX_HEATMAP_LAYOUT_CALLS,
+	/** FlexState#layoutCount, the number of times the widget was laid out. */
+	FLEX_HEATMAP_LAYOUT_COUNT
+};
+
+/**
+ * Writes the laid out tree as an SVG image colored by the statistics of the last pass.
+ *
+ * Each widget is drawn as a rectangle whose color goes from blue to red as
+ * the statistic approaches its maximum in the tree. Widgets not laid out in
+ * the last pass of the root are drawn blank. The statistics are also
+ * included as tooltips.
+ *
+ * @param context The context, which must have per-widget state and specify
+ * FlexContext#getX and FlexContext#getY.
+ * @param widget The root of the tree.
+ * @param heatmap The statistic to color the widgets by.
+ * @param file The file to write to.
+ * @return Whether the image was written successfully.
+ */
+int flexDumpSvg(const struct FlexContext *context, void *widget, enum FlexHeatmap heatmap, FILE *file);
+
+/**
+ * Reports the widgets laid out more than \a threshold times during the last pass.
+ *
+ * Nested containers that measure their children before laying them out
+ * multiply the number of layouts of their descendants, so the count of a
+ * widget is the product of the ancestors that laid it out repeatedly. The
+ * widgets are reported in preorder together with their ancestors, whose
+ * FlexState#layoutCount shows where the cascade originates. The descendants of
+ * a reported widget are usually reported as well.
+ *
+ * @param context The context, which must have per-widget state.
+ * @param widget The root of the tree.
+ * @param threshold The largest acceptable number of layouts.
+ * @param report Called for each widget above the threshold with \a userData,
+ * the widget, its FlexState#layoutCount, and its ancestors ordered from the
+ * root to the parent.
+ * @param userData Pointer passed to \a report.
+ * @return The number of widgets reported, or \c -1 if out of memory.
+ */
+int flexFindCascades(const struct FlexContext *context, void *widget, int threshold, void (*report)(void *userData, void *widget, int layoutCount, void *const *ancestors, int depth), void *userData);
+
+/** A field of the layout result of a widget. */
+enum FlexField {
+	FLEX_FIELD_X,
+	FLEX_FIELD_Y,
+	FLEX_FIELD_WIDTH,
+	FLEX_FIELD_HEIGHT
+};
+
+/** The first difference found by #flexVerifyLayout. */
+struct FlexDivergence {
+	/** The widget whose layout differs. */
+	void *widget;
+	/** The index of the widget in preorder, where the root is \c 0. */
+	int index;
+	/** The field that differs. */
+	enum FlexField field;
+	/** The value computed with the reference context. */
+	float expected;
+	/** The value computed with the verified context. */
+	float actual;
+};
+
+/**
+ * Lays out the tree with a reference context and then with the verified one, and compares the results.
+ *
+ * Used to check optimized configurations, such as contexts with a
+ * FlexContext#scheduler, against the plain algorithm. Before each layout, the
+ * sizes of the widgets and the positions of the descendants are overwritten
+ * through \a reference with a NaN that differs between the two, and the
+ * layouts cached for the tree are invalidated, so that each context computes
+ * every result itself. A FlexContext#measureCache is not used, but replaced
+ * by an empty one for the layout, leaving the caches of other trees intact. The widgets are then compared in preorder, and the first
+ * position or size that is not bitwise equal, including the payload of NaNs,
+ * is reported. The tree is left laid out by \a context.
+ *
+ * @param context The verified context, which must specify FlexContext#getX
+ * and FlexContext#getY.
+ * @param reference The reference context over the same widgets, usually
+ * \a context without its optional members.
+ * @param widget The root of the tree.
+ * @param width The available width.
+ * @param widthMode The width requirement.
+ * @param height The available height.
+ * @param heightMode The height requirement.
+ * @param direction The direction of the root.
+ * @param justify The alignment of the children of the root in the main axis.
+ * @param divergence Set to the first difference, if any.
+ * @return \c 1 if the layouts match, \c 0 if they diverge, or \c -1 if out of memory.
+ */
+int flexVerifyLayout(const struct FlexContext *context, const struct FlexContext *reference, void *widget,
+		float width, enum MeasureMode widthMode, float height, enum MeasureMode heightMode,
+		enum FlexDirection direction, enum Align justify, struct FlexDivergence *divergence);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
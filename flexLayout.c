@@ -1,11 +1,307 @@
+#define _POSIX_C_SOURCE 199309L
 #include "flexLayout.h"
+#include "flexCache.h"
+#include "flexParams.h"
+#include "flexTable.h"
+#include <stdlib.h>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <time.h>
+#endif
 
 #define MAX(x, y) (((x) > (y)) ? (x) : (y))
 
+#ifdef _MSC_VER
+#define FLEX_THREAD_LOCAL __declspec(thread)
+#define FLEX_INLINE __forceinline
+#define atomicIncrement(x) _InterlockedIncrement(x)
+#define atomicAdd(x, value) (_InterlockedExchangeAdd(x, value) + (value))
+#else
+#define FLEX_THREAD_LOCAL __thread
+#define FLEX_INLINE inline __attribute__((always_inline))
+#define atomicIncrement(x) __sync_add_and_fetch(x, 1)
+#define atomicAdd(x, value) __sync_add_and_fetch(x, value)
+#endif
+
+/** The number of layout pass numbers a thread reserves at once, so that threads rarely share #passCount. */
+#define PASS_BLOCK 1024
+
+/** The number of layout pass numbers reserved by all threads. */
+static volatile long passCount;
+/** The last pass number used by this thread, and the last it reserved. */
+static FLEX_THREAD_LOCAL long lastPass, lastReservedPass;
+/** The epoch of valid cached layouts. */
+static volatile long epoch;
+/** The context of the innermost layout call on this thread. */
+static FLEX_THREAD_LOCAL const struct FlexContext *currentContext;
+/** The layout pass of the innermost layout call on this thread. */
+static FLEX_THREAD_LOCAL long currentPass;
+
+#ifdef FLEX_LAYOUT_PROFILE
+/** The depth of the innermost container being laid out on this thread. */
+static FLEX_THREAD_LOCAL int currentDepth;
+#define PROFILE_BEGIN(context, scope, widget, depth) do { \
+	if ((context)->profiler) (context)->profiler->begin((context)->profiler->userData, scope, widget, depth); \
+} while (0)
+#define PROFILE_END(context, scope, widget, depth) do { \
+	if ((context)->profiler) (context)->profiler->end((context)->profiler->userData, scope, widget, depth); \
+} while (0)
+#else
+#define PROFILE_BEGIN(context, scope, widget, depth) ((void) 0)
+#define PROFILE_END(context, scope, widget, depth) ((void) 0)
+#endif
+
 int isUndefined(float value) {
 	return isnan(value);
 }
 
+/** Returns a monotonic time in seconds. */
+static double getTime(void) {
+#ifdef _WIN32
+	LARGE_INTEGER counter, frequency;
+	QueryPerformanceCounter(&counter);
+	QueryPerformanceFrequency(&frequency);
+	return (double) counter.QuadPart / frequency.QuadPart;
+#else
+	struct timespec time;
+	clock_gettime(CLOCK_MONOTONIC, &time);
+	return time.tv_sec + time.tv_nsec * 1e-9;
+#endif
+}
+
+#ifdef FLEX_LAYOUT_PROFILE
+/** A callback, or the library if #callback is negative, that time on this thread is attributed to. */
+struct Segment {
+	struct FlexStats *stats;
+	int callback;
+};
+
+static FLEX_THREAD_LOCAL struct Segment currentSegment;
+/** When the current segment started. */
+static FLEX_THREAD_LOCAL double segmentStart;
+
+/** Attributes the time until the next switch to the specified segment, returning the previous one. */
+static struct Segment enterSegment(struct FlexStats *stats, int callback) {
+	struct Segment outer = currentSegment;
+	if (stats || outer.stats) {
+		double now = getTime();
+		if (outer.stats) *(outer.callback < 0 ? &outer.stats->libraryTime : &outer.stats->callbackTime[outer.callback]) += now - segmentStart;
+		segmentStart = now;
+	}
+	currentSegment.stats = stats;
+	currentSegment.callback = callback;
+	return outer;
+}
+
+#define BEGIN_CALLBACK(context, callback) \
+	struct Segment outerSegment = enterSegment((context)->stats, callback); \
+	if ((context)->stats) ++(context)->stats->callbackCalls[callback]
+#define END_CALLBACK(context) enterSegment(outerSegment.stats, outerSegment.callback)
+#else
+#define BEGIN_CALLBACK(context, callback) ((void) 0)
+#define END_CALLBACK(context) ((void) 0)
+#endif
+
+void flexStatsReset(struct FlexStats *stats) {
+	stats->libraryTime = 0;
+	stats->libraryCalls = 0;
+	for (int i = 0; i < FLEX_CALLBACK_COUNT; ++i) {
+		stats->callbackTime[i] = 0;
+		stats->callbackCalls[i] = 0;
+	}
+}
+
+void flexStatsMerge(struct FlexStats *stats, const struct FlexStats *other) {
+	stats->libraryTime += other->libraryTime;
+	stats->libraryCalls += other->libraryCalls;
+	for (int i = 0; i < FLEX_CALLBACK_COUNT; ++i) {
+		stats->callbackTime[i] += other->callbackTime[i];
+		stats->callbackCalls[i] += other->callbackCalls[i];
+	}
+}
+
+/** Returns a new pass number, unique across threads. */
+static long startPass(void) {
+	if (lastPass == lastReservedPass) lastPass = (lastReservedPass = atomicAdd(&passCount, PASS_BLOCK)) - PASS_BLOCK;
+	return ++lastPass;
+}
+
+/** An option set on the contexts of #flexMeasure, which are embedded in a #MeasureContext. */
+#define OPTION_MEASURE 0x80000000u
+
+/** Members of a context that layout must check for, which are tested once per container. */
+enum Feature {
+	/** The context keeps per-widget state. */
+	FEATURE_STATE = 1,
+	/** The context is the one of #flexMeasure, with #OPTION_MEASURE. */
+	FEATURE_MEASURE = 2,
+	/** The parameters are interned, see #FLEX_OPTION_INTERNED_PARAMS. */
+	FEATURE_INTERNED = 4,
+	/** The context has a FlexContext#measureCache. */
+	FEATURE_MEASURE_CACHE = 8,
+	/** Containers may collapse, see FlexContext#minSize. */
+	FEATURE_MIN_SIZE = 16
+};
+
+/**
+ * Returns the #Feature values of the context.
+ *
+ * A context without any takes a copy of the algorithm specialized for it, in
+ * which the checks for them in the loops over the children are folded away.
+ */
+static unsigned getFeatures(const struct FlexContext *context) {
+	return (context->getState || context->stateTable ? FEATURE_STATE : 0)
+		| (context->options & OPTION_MEASURE ? FEATURE_MEASURE : 0)
+		| (context->options & FLEX_OPTION_INTERNED_PARAMS ? FEATURE_INTERNED : 0)
+		| (context->measureCache ? FEATURE_MEASURE_CACHE : 0)
+		| (context->minSize > 0 ? FEATURE_MIN_SIZE : 0);
+}
+
+const struct FlexContext *flexCurrentContext(void) {
+	return currentContext;
+}
+
+void flexScratchInit(struct FlexScratch *scratch) {
+	scratch->data = NULL;
+	scratch->size = scratch->capacity = 0;
+}
+
+void flexScratchDestroy(struct FlexScratch *scratch) {
+	free(scratch->data);
+	flexScratchInit(scratch);
+}
+
+/**
+ * Reserves \a count floats at the top of the scratch buffer.
+ *
+ * Nested layout may reallocate the storage, so the reservation is identified
+ * by its offset rather than by a pointer.
+ * @return The offset of the reservation, or \c -1 if out of memory.
+ */
+static int pushScratch(struct FlexScratch *scratch, int count) {
+	int offset = scratch->size;
+	if (offset + count > scratch->capacity) {
+		int capacity = MAX(2 * scratch->capacity, offset + count);
+		float *data = realloc(scratch->data, capacity * sizeof *data);
+		if (!data) return -1;
+		scratch->data = data;
+		scratch->capacity = capacity;
+	}
+	scratch->size += count;
+	return offset;
+}
+
+/** Flags of the recorded sizes of a #Measured. */
+enum {
+	MEASURED_WIDTH = 1,
+	MEASURED_HEIGHT = 2
+};
+
+/** The size of a widget recorded by #flexMeasure instead of setting it. */
+struct Measured {
+	float width, height;
+	int flags;
+};
+
+struct MeasureContext {
+	struct FlexContext context;
+	/** The #Measured sizes of the widgets. */
+	struct FlexTable sizes;
+	/** Whether a size could not be recorded for lack of memory. */
+	int failed;
+};
+
+static const struct Measured *findMeasured(const struct FlexContext *context, void *widget, int flag) {
+	const struct Measured *measured = flexTableFind(&((const struct MeasureContext *) context)->sizes, widget);
+	return measured && measured->flags & flag ? measured : NULL;
+}
+
+static void setMeasured(const struct FlexContext *context, void *widget, int flag, float size) {
+	struct MeasureContext *measureContext = (struct MeasureContext *) context;
+	struct Measured *measured = flexTableGet(&measureContext->sizes, widget);
+	if (!measured) {
+		measureContext->failed = 1;
+		return;
+	}
+	*(flag == MEASURED_WIDTH ? &measured->width : &measured->height) = size;
+	measured->flags |= flag;
+}
+
+static void setPosition(const struct FlexContext *context, const unsigned features, void *widget, enum FlexDirection axis, float position) {
+	if (features & FEATURE_MEASURE) return;
+	BEGIN_CALLBACK(context, axis == DIRECTION_ROW ? FLEX_CALLBACK_SET_X : FLEX_CALLBACK_SET_Y);
+	(axis == DIRECTION_ROW ? context->setX : context->setY)(widget, position);
+	END_CALLBACK(context);
+}
+
+static float getWidth(const struct FlexContext *context, const unsigned features, void *widget) {
+	const struct Measured *measured;
+	if (features & FEATURE_MEASURE && (measured = findMeasured(context, widget, MEASURED_WIDTH))) return measured->width;
+	BEGIN_CALLBACK(context, FLEX_CALLBACK_GET_WIDTH);
+	float width = context->getWidth(widget);
+	END_CALLBACK(context);
+	return width;
+}
+
+static void setWidth(const struct FlexContext *context, const unsigned features, void *widget, float width) {
+	if (features & FEATURE_MEASURE) {
+		setMeasured(context, widget, MEASURED_WIDTH, width);
+		return;
+	}
+	BEGIN_CALLBACK(context, FLEX_CALLBACK_SET_WIDTH);
+	context->setWidth(widget, width);
+	END_CALLBACK(context);
+}
+
+static float getHeight(const struct FlexContext *context, const unsigned features, void *widget) {
+	const struct Measured *measured;
+	if (features & FEATURE_MEASURE && (measured = findMeasured(context, widget, MEASURED_HEIGHT))) return measured->height;
+	BEGIN_CALLBACK(context, FLEX_CALLBACK_GET_HEIGHT);
+	float height = context->getHeight(widget);
+	END_CALLBACK(context);
+	return height;
+}
+
+static void setHeight(const struct FlexContext *context, const unsigned features, void *widget, float height) {
+	if (features & FEATURE_MEASURE) {
+		setMeasured(context, widget, MEASURED_HEIGHT, height);
+		return;
+	}
+	BEGIN_CALLBACK(context, FLEX_CALLBACK_SET_HEIGHT);
+	context->setHeight(widget, height);
+	END_CALLBACK(context);
+}
+
+static int getChildCount(const struct FlexContext *context, void *widget) {
+	BEGIN_CALLBACK(context, FLEX_CALLBACK_GET_CHILD_COUNT);
+	int childCount = context->getChildCount(widget);
+	END_CALLBACK(context);
+	return childCount;
+}
+
+static void *getChildAt(const struct FlexContext *context, void *widget, int index) {
+	BEGIN_CALLBACK(context, FLEX_CALLBACK_GET_CHILD_AT);
+	void *child = context->getChildAt(widget, index);
+	END_CALLBACK(context);
+	return child;
+}
+
+static struct FlexParams *getLayoutParams(const struct FlexContext *context, void *widget) {
+	BEGIN_CALLBACK(context, FLEX_CALLBACK_GET_LAYOUT_PARAMS);
+	struct FlexParams *params = context->getLayoutParams(widget);
+	END_CALLBACK(context);
+	return params;
+}
+
+static unsigned long long getContentHash(const struct FlexContext *context, void *widget) {
+	if (!context->getContentHash) return 0;
+	BEGIN_CALLBACK(context, FLEX_CALLBACK_GET_CONTENT_HASH);
+	unsigned long long hash = context->getContentHash(widget);
+	END_CALLBACK(context);
+	return hash;
+}
+
 static enum FlexDirection getPerpendicularAxis(enum FlexDirection axis) {
 	return axis == DIRECTION_ROW ? DIRECTION_COLUMN : DIRECTION_ROW;
 }
@@ -18,7 +314,14 @@ static float getTrailingMargin(struct FlexParams *params, enum FlexDirection axi
 	return axis == DIRECTION_ROW ? params->marginRight : params->marginBottom;
 }
 
-static float getMargin(struct FlexParams *params, enum FlexDirection axis) {
+/** Returns the values derived from the parameters, if interned as declared by #FLEX_OPTION_INTERNED_PARAMS. */
+static const struct FlexInternedParams *getInterned(const unsigned features, struct FlexParams *params) {
+	return features & FEATURE_INTERNED ? (const struct FlexInternedParams *) params : NULL;
+}
+
+static float getMargin(const unsigned features, struct FlexParams *params, enum FlexDirection axis) {
+	const struct FlexInternedParams *interned = getInterned(features, params);
+	if (interned) return interned->margins[axis];
 	return getLeadingMargin(params, axis) + getTrailingMargin(params, axis);
 }
 
@@ -26,42 +329,337 @@ static float getStyleSize(struct FlexParams *params, enum FlexDirection axis) {
 	return axis == DIRECTION_ROW ? params->width : params->height;
 }
 
-static float getLayoutSize(const struct FlexContext *context, void *widget, enum FlexDirection axis) {
-	return axis == DIRECTION_ROW ? context->getWidth(widget) : context->getHeight(widget);
+static int hasStyleSize(const unsigned features, struct FlexParams *params, enum FlexDirection axis) {
+	const struct FlexInternedParams *interned = getInterned(features, params);
+	if (interned) return interned->hasSize[axis];
+	return !isUndefined(getStyleSize(params, axis));
+}
+
+static float getLayoutSize(const struct FlexContext *context, const unsigned features, void *widget, enum FlexDirection axis) {
+	return axis == DIRECTION_ROW ? getWidth(context, features, widget) : getHeight(context, features, widget);
+}
+
+static void setBasis(const struct FlexContext *context, const unsigned features, int bases, int index, void *child, float basis) {
+	if (bases < 0) setWidth(context, features, child, basis); // Store the basis in the child's width dimension
+	else context->scratch->data[bases + index] = basis;
+}
+
+static float getBasis(const struct FlexContext *context, const unsigned features, int bases, int index, void *child) {
+	return bases < 0 ? getWidth(context, features, child) : context->scratch->data[bases + index];
+}
+
+static struct FlexState *getState(const struct FlexContext *context, void *widget) {
+	if (!context->getState) {
+		if (!context->stateTable) return NULL;
+		// Measuring leaves the table as it is
+		return context->options & OPTION_MEASURE ? flexTableFind(context->stateTable, widget) : flexTableGet(context->stateTable, widget);
+	}
+	BEGIN_CALLBACK(context, FLEX_CALLBACK_GET_STATE);
+	struct FlexState *state = context->getState(widget);
+	END_CALLBACK(context);
+	return state;
+}
+
+/** Returns the state of the widget, with the statistics of earlier passes cleared if recorded. */
+static struct FlexState *getPassState(const struct FlexContext *context, void *widget) {
+	struct FlexState *state = getState(context, widget);
+	if (state && context->options & FLEX_OPTION_STATS && state->pass != currentPass) {
+		state->pass = currentPass;
+		state->time = 0;
+		state->layoutCount = state->layoutCalls = 0;
+	}
+	return state;
+}
+
+struct FlexState *flexGetState(const struct FlexContext *context, void *widget) {
+	if (context->getState) return context->getState(widget);
+	return context->stateTable ? flexTableFind(context->stateTable, widget) : NULL;
+}
+
+void flexInvalidateAll(void) {
+	atomicIncrement(&epoch);
+}
+
+long flexGetEpoch(void) {
+	return epoch;
+}
+
+void flexMarkDirty(const struct FlexContext *context, void *widget, int flags) {
+	struct FlexState *state = getState(context, widget);
+	if (state) state->flags |= flags & FLEX_DIRTY;
+}
+
+/** Returns whether the cached sizes in the axes given by the #FlexStateFlag values are stale. */
+static int isStale(const struct FlexState *state, int axes) {
+	return state->flags & axes || state->epoch != epoch;
+}
+
+static int getDirtyFlag(enum FlexDirection axis) {
+	return axis == DIRECTION_ROW ? FLEX_DIRTY_WIDTH : FLEX_DIRTY_HEIGHT;
+}
+
+/** Drops the cached layouts if stale, as the widget is about to be laid out anew. */
+static void cleanState(struct FlexState *state) {
+	if (!isStale(state, FLEX_DIRTY)) return;
+	state->flags &= ~(FLEX_DIRTY | FLEX_LAID_OUT);
+	state->measurementCount = state->nextMeasurement = 0;
+	state->epoch = epoch;
+}
+
+static int isSameSize(float a, float b) {
+	return a == b || (isUndefined(a) && isUndefined(b));
+}
+
+static int hasConstraints(const struct FlexMeasurement *measurement, float width, enum MeasureMode widthMode, float height, enum MeasureMode heightMode) {
+	return measurement->widthMode == widthMode && measurement->heightMode == heightMode
+		&& isSameSize(measurement->width, width) && isSameSize(measurement->height, height);
+}
+
+/** Returns the cached measurement with the constraints, or \c NULL. */
+static struct FlexMeasurement *findMeasurement(struct FlexState *state, float width, enum MeasureMode widthMode, float height, enum MeasureMode heightMode) {
+	for (int i = 0; i < state->measurementCount; ++i) {
+		if (hasConstraints(state->measurements + i, width, widthMode, height, heightMode)) return state->measurements + i;
+	}
+	return NULL;
+}
+
+/**
+ * Returns a cached layout that a layout of the widget with the constraints may be skipped for, or \c NULL.
+ *
+ * A measurement is valid as long as its axis is clean, even if the size in
+ * the other axis is stale. Besides a changed widget itself, only
+ * containers whose cross axis alone holds the change have a single axis dirty.
+ * @param measure The dirty flag of the axis whose size is all that is needed, or \c 0 if the layout of the descendants is needed.
+ */
+static const struct FlexMeasurement *findCachedLayout(struct FlexState *state, float width, enum MeasureMode widthMode, float height, enum MeasureMode heightMode, int measure) {
+	if (isStale(state, measure ? measure : FLEX_DIRTY)) return NULL;
+	if (state->flags & FLEX_LAID_OUT && hasConstraints(&state->layout, width, widthMode, height, heightMode)) return &state->layout;
+	return measure ? findMeasurement(state, width, widthMode, height, heightMode) : NULL;
+}
+
+static void cacheLayout(const struct FlexContext *context, const unsigned features, void *widget, struct FlexState *state, float width, enum MeasureMode widthMode, float height, enum MeasureMode heightMode) {
+	struct FlexMeasurement *measurement = findMeasurement(state, width, widthMode, height, heightMode);
+	if (!measurement) {
+		measurement = state->measurements + state->nextMeasurement;
+		state->nextMeasurement = (state->nextMeasurement + 1) % FLEX_CACHE_SIZE;
+		if (state->measurementCount < FLEX_CACHE_SIZE) ++state->measurementCount;
+	}
+	measurement->width = width;
+	measurement->widthMode = widthMode;
+	measurement->height = height;
+	measurement->heightMode = heightMode;
+	measurement->resultWidth = getWidth(context, features, widget);
+	measurement->resultHeight = getHeight(context, features, widget);
+	state->layout = *measurement;
+	state->flags |= FLEX_LAID_OUT;
+}
+
+/** Lays out the widget with the context of #flexMeasure, recording its size without keeping any changes to it. */
+static void measureWidget(const struct FlexContext *context, const unsigned features, void *widget, float width, enum MeasureMode widthMode, float height, enum MeasureMode heightMode) {
+	struct FlexTable *sizes = &((struct MeasureContext *) context)->sizes;
+	struct Measured *measured = flexTableFind(sizes, widget);
+	if (measured) measured->flags = 0;
+	float oldWidth = getWidth(context, features, widget), oldHeight = getHeight(context, features, widget);
+	context->layout(widget, width, widthMode, height, heightMode);
+	// Containers record their size, while leaves set it on themselves and are reverted
+	if ((measured = flexTableFind(sizes, widget)) && measured->flags == (MEASURED_WIDTH | MEASURED_HEIGHT)) return;
+	float newWidth = getWidth(context, features, widget), newHeight = getHeight(context, features, widget);
+	context->setWidth(widget, oldWidth);
+	context->setHeight(widget, oldHeight);
+	setWidth(context, features, widget, newWidth);
+	setHeight(context, features, widget, newHeight);
+}
+
+/**
+ * Lays out a child of the current container.
+ *
+ * When measuring, cached layouts are used but not updated.
+ * @param features The #Feature values of the context.
+ * @param measure The dirty flag of the axis whose size is all that is needed, or \c 0 if the child is to be positioned.
+ */
+static FLEX_INLINE void layoutChild(const struct FlexContext *context, const unsigned features, void *child, float width, enum MeasureMode widthMode, float height, enum MeasureMode heightMode, int measure) {
+	int measuring = features & FEATURE_MEASURE;
+	struct FlexState *state = !(features & FEATURE_STATE) ? NULL : measuring ? getState(context, child) : getPassState(context, child);
+	int cache = state && context->options & FLEX_OPTION_CACHE;
+	if (cache) {
+		const struct FlexMeasurement *measurement = findCachedLayout(state, width, widthMode, height, heightMode, measure);
+		if (measurement) {
+			setWidth(context, features, child, measurement->resultWidth);
+			setHeight(context, features, child, measurement->resultHeight);
+			return;
+		}
+		if (measuring) cache = 0;
+		else cleanState(state);
+	}
+
+	// Leaves with the content of a widget measured before need not be laid out
+	unsigned long long hash = features & FEATURE_MEASURE_CACHE ? getContentHash(context, child) : 0;
+	struct FlexMeasurement measurement = { width, widthMode, height, heightMode, 0, 0 };
+	if (hash && flexMeasureCacheFind(context->measureCache, hash, &measurement)) {
+		setWidth(context, features, child, measurement.resultWidth);
+		setHeight(context, features, child, measurement.resultHeight);
+	} else {
+		if (state && !measuring && context->options & FLEX_OPTION_STATS) ++state->layoutCount;
+#ifdef FLEX_LAYOUT_PROFILE
+		int depth = ++currentDepth;
+		PROFILE_BEGIN(context, FLEX_SCOPE_LAYOUT, child, depth);
+#endif
+		BEGIN_CALLBACK(context, FLEX_CALLBACK_LAYOUT);
+		if (measuring) measureWidget(context, features, child, width, widthMode, height, heightMode);
+		else context->layout(child, width, widthMode, height, heightMode);
+		END_CALLBACK(context);
+#ifdef FLEX_LAYOUT_PROFILE
+		PROFILE_END(context, FLEX_SCOPE_LAYOUT, child, depth);
+		--currentDepth;
+#endif
+		if (hash) {
+			measurement.resultWidth = getWidth(context, features, child);
+			measurement.resultHeight = getHeight(context, features, child);
+			flexMeasureCacheStore(context->measureCache, hash, &measurement);
+		}
+	}
+	// Nested layout may have moved the state
+	if (cache && (state = getState(context, child))) cacheLayout(context, features, child, state, width, widthMode, height, heightMode);
+}
+
+static int getNodeCount(const struct FlexContext *context, void *widget) {
+	struct FlexState *state = getState(context, widget);
+	return state && state->nodeCount ? state->nodeCount : 1;
 }
 
 static int isFlexBasisAuto(struct FlexParams *params) {
 	return params->flex <= 0;
 }
 
-static float getFlexGrowFactor(struct FlexParams *params) {
+static float getFlexGrowFactor(const unsigned features, struct FlexParams *params) {
+	const struct FlexInternedParams *interned = getInterned(features, params);
+	if (interned) return interned->growFactor;
 	float flex = params->flex;
 	if (flex > 0) return flex;
 	return 0;
 }
 
-static int getFlexShrinkFactor(struct FlexParams *params) {
+static int getFlexShrinkFactor(const unsigned features, struct FlexParams *params) {
+	const struct FlexInternedParams *interned = getInterned(features, params);
+	if (interned) return interned->shrinkFactor;
 	return params->flex < 0;
 }
 
-void layoutFlex(const struct FlexContext *context, void *widget, float width, enum MeasureMode widthMode, float height, enum MeasureMode heightMode, enum FlexDirection direction, enum Align justify) {
+void flexRunTask(const struct FlexTask *task, const struct FlexContext *context) {
+	const struct FlexContext *outerContext = currentContext;
+	long outerPass = currentPass;
+	if (!context) context = task->context;
+	currentContext = context;
+	currentPass = task->pass;
+#ifdef FLEX_LAYOUT_PROFILE
+	int outerDepth = currentDepth;
+	currentDepth = task->depth - 1;
+#endif
+	layoutChild(context, getFeatures(context), task->widget, task->width, task->widthMode, task->height, task->heightMode, 0);
+	currentContext = outerContext;
+	currentPass = outerPass;
+#ifdef FLEX_LAYOUT_PROFILE
+	currentDepth = outerDepth;
+#endif
+}
+
+/** Lays out the children described by \a tasks, spawning all but the last on the scheduler. */
+static void runTasks(const struct FlexContext *context, struct FlexTask *tasks, int count) {
+	const struct FlexScheduler *scheduler = context->scheduler;
+	void **handles = malloc((count - 1) * sizeof *handles);
+	if (!handles) {
+		for (int i = 0; i < count; ++i) flexRunTask(&tasks[i], context);
+		return;
+	}
+	for (int i = 0; i < count - 1; ++i) handles[i] = scheduler->spawn(scheduler->userData, &tasks[i]);
+	flexRunTask(&tasks[count - 1], context);
+	for (int i = 0; i < count - 1; ++i) {
+		if (handles[i]) scheduler->wait(scheduler->userData, handles[i]);
+	}
+	free(handles);
+}
+
+static void positionInMainAxis(const struct FlexContext *context, const unsigned features, void *child, struct FlexParams *params, enum FlexDirection mainAxis, float betweenMain, int *mainSize, int *crossSize) {
+	setPosition(context, features, child, mainAxis, *mainSize + getLeadingMargin(params, mainAxis));
+	*mainSize += betweenMain + getLayoutSize(context, features, child, mainAxis) + getMargin(features, params, mainAxis);
+	enum FlexDirection crossAxis = getPerpendicularAxis(mainAxis);
+	*crossSize = MAX(*crossSize, getLayoutSize(context, features, child, crossAxis) + getMargin(features, params, crossAxis));
+}
+
+/** Returns whether a container with the constraints is too small to be laid out, see FlexContext#minSize. */
+static int isBelowMinSize(const struct FlexContext *context, float width, enum MeasureMode widthMode, float height, enum MeasureMode heightMode) {
+	// An unspecified size is unbounded, and a bound of either mode is all the container may take
+	return widthMode != MEASURE_UNSPECIFIED && width < context->minSize && heightMode != MEASURE_UNSPECIFIED && height < context->minSize;
+}
+
+/** Gives the descendants of the widget empty rectangles, as they are not laid out. */
+static void collapse(const struct FlexContext *context, const unsigned features, void *widget) {
+	// Laying out the widget again with the same constraints must not reuse the collapsed descendants
+	struct FlexState *state = getState(context, widget);
+	if (state) state->flags &= ~FLEX_LAID_OUT;
+	for (int i = 0, childCount = getChildCount(context, widget); i < childCount; ++i) {
+		void *child = getChildAt(context, widget, i);
+		setPosition(context, features, child, DIRECTION_ROW, 0);
+		setPosition(context, features, child, DIRECTION_COLUMN, 0);
+		setWidth(context, features, child, 0);
+		setHeight(context, features, child, 0);
+		collapse(context, features, child);
+	}
+}
+
+/** Lays out the container as #layoutFlex, with checks only for the #Feature values in \a features. */
+static FLEX_INLINE void layoutContainer(const struct FlexContext *context, const unsigned features, void *widget, float width, enum MeasureMode widthMode, float height, enum MeasureMode heightMode, enum FlexDirection direction, enum Align justify) {
+	int measuring = features & FEATURE_MEASURE;
+	int stats = features & FEATURE_STATE && !measuring && context->options & FLEX_OPTION_STATS;
+	const struct FlexContext *outerContext = currentContext;
+	long outerPass = currentPass;
+	if (!outerContext && stats) currentPass = startPass(); // Start a new pass at the root
+	currentContext = context;
+#ifdef FLEX_LAYOUT_PROFILE
+	if (!outerContext) currentDepth = 0;
+	PROFILE_BEGIN(context, FLEX_SCOPE_CONTAINER, widget, currentDepth);
+	struct Segment librarySegment = enterSegment(context->stats, -1);
+	if (context->stats) ++context->stats->libraryCalls;
+#endif
+	double startTime = stats ? getTime() : 0;
+	if (features & FEATURE_STATE && context->options & FLEX_OPTION_CACHE && !measuring) {
+		// The descendants are laid out anew, invalidating the cached layout unless called by layoutChild
+		struct FlexState *state = getState(context, widget);
+		if (state) {
+			cleanState(state);
+			state->flags &= ~FLEX_LAID_OUT;
+		}
+	}
+	if (context->onLayoutFlex) {
+		BEGIN_CALLBACK(context, FLEX_CALLBACK_ON_LAYOUT_FLEX);
+		context->onLayoutFlex(widget, width, widthMode, height, heightMode, direction, justify);
+		END_CALLBACK(context);
+	}
+
+	// A collapsed container is sized as if it had no children, after the hooks and statistics have seen the call
+	int collapsed = features & FEATURE_MIN_SIZE && isBelowMinSize(context, width, widthMode, height, heightMode);
+	if (collapsed && !measuring) collapse(context, features, widget); // Measuring only needs the size
+
 	enum FlexDirection mainAxis = direction, crossAxis = getPerpendicularAxis(mainAxis);
-	int childCount = context->getChildCount(widget);
+	int childCount = collapsed ? 0 : getChildCount(context, widget);
 	enum MeasureMode mainMeasureMode = mainAxis == DIRECTION_ROW ? widthMode : heightMode,
 					 crossMeasureMode = crossAxis == DIRECTION_ROW ? widthMode : heightMode;
 	float availableMain = mainAxis == DIRECTION_ROW ? width : height,
 		  availableCross = crossAxis == DIRECTION_ROW ? width : height;
+	int bases = context->scratch ? pushScratch(context->scratch, childCount) : -1; // Offset of the bases in the scratch buffer
 
 	// Determine basis for each child
 	float sizeConsumed = 0, // Dimensions of the content in the main axis
 		  totalFlexGrowFactors = 0, totalFlexShrinkScaledFactors = 0;
+	int totalCost = 0; // Estimated cost of laying out the children, if a scheduler is present
+	int layoutCalls = childCount; // Number of children laid out, counting the final layout of each
 	for (int i = 0; i < childCount; ++i) {
-		void *child = context->getChildAt(widget, i);
-		struct FlexParams *params = context->getLayoutParams(child);
-		float styleSize = getStyleSize(params, mainAxis), basis;
+		void *child = getChildAt(context, widget, i);
+		struct FlexParams *params = getLayoutParams(context, child);
+		float basis;
 
-		if (!isUndefined(styleSize)) {
-			basis = styleSize;
+		if (hasStyleSize(features, params, mainAxis)) {
+			basis = getStyleSize(params, mainAxis);
 		} else if (!isFlexBasisAuto(params) && availableMain) {
 			basis = 0;
 		} else {
@@ -69,7 +667,7 @@ void layoutFlex(const struct FlexContext *context, void *widget, float width, en
 			float childWidth, childHeight;
 			enum MeasureMode childWidthMode, childHeightMode;
 
-			if (!isUndefined(getStyleSize(params, DIRECTION_ROW))) {
+			if (hasStyleSize(features, params, DIRECTION_ROW)) {
 				childWidth = params->width;
 				childWidthMode = MEASURE_EXACTLY;
 			} else if (crossAxis == DIRECTION_ROW && widthMode == MEASURE_EXACTLY && params->align == ALIGN_STRETCH) {
@@ -80,7 +678,7 @@ void layoutFlex(const struct FlexContext *context, void *widget, float width, en
 				childWidthMode = widthMode == MEASURE_UNSPECIFIED ? MEASURE_UNSPECIFIED : MEASURE_AT_MOST;
 			}
 
-			if (!isUndefined(getStyleSize(params, DIRECTION_COLUMN))) {
+			if (hasStyleSize(features, params, DIRECTION_COLUMN)) {
 				childHeight = params->height;
 				childHeightMode = MEASURE_EXACTLY;
 			} else if (crossAxis == DIRECTION_COLUMN && heightMode == MEASURE_EXACTLY && params->align == ALIGN_STRETCH) {
@@ -91,14 +689,16 @@ void layoutFlex(const struct FlexContext *context, void *widget, float width, en
 				childHeightMode = heightMode == MEASURE_UNSPECIFIED ? MEASURE_UNSPECIFIED : MEASURE_AT_MOST;
 			}
 
-			context->layout(child, childWidth, childWidthMode, childHeight, childHeightMode);
-			basis = getLayoutSize(context, child, mainAxis);
+			layoutChild(context, features, child, childWidth, childWidthMode, childHeight, childHeightMode, getDirtyFlag(mainAxis));
+			++layoutCalls;
+			basis = getLayoutSize(context, features, child, mainAxis);
 		}
 
-		context->setWidth(child, basis); // Store the basis in the child's width dimension
-		sizeConsumed += basis + getMargin(params, mainAxis);
-		totalFlexGrowFactors += getFlexGrowFactor(params);
-		totalFlexShrinkScaledFactors += getFlexShrinkFactor(params) * basis;
+		setBasis(context, features, bases, i, child, basis);
+		sizeConsumed += basis + getMargin(features, params, mainAxis);
+		totalFlexGrowFactors += getFlexGrowFactor(features, params);
+		totalFlexShrinkScaledFactors += getFlexShrinkFactor(features, params) * basis;
+		if (context->scheduler) totalCost += features & FEATURE_STATE ? getNodeCount(context, child) : 1;
 	}
 
 	// Layout flexible children and allocate empty space
@@ -124,32 +724,59 @@ void layoutFlex(const struct FlexContext *context, void *widget, float width, en
 				break;
 		}
 	}
-	int mainSize = leadingMainSize, crossSize = 0;
+	int mainSize = leadingMainSize, crossSize = 0, nodeCount = features & FEATURE_STATE && collapsed ? getNodeCount(context, widget) : 1;
+	// Defer the layout of the children to the scheduler if the work is worth it
+	struct FlexTask *tasks = context->scheduler && childCount > 1 && totalCost >= context->scheduler->minCost
+		? malloc(childCount * sizeof *tasks) : NULL;
 	for (int i = 0; i < childCount; ++i) {
-		void *child = context->getChildAt(widget, i);
-		struct FlexParams *params = context->getLayoutParams(child);
-		float childCrossStyleSize = getStyleSize(params, crossAxis);
-		float childBasis = context->getWidth(child);
+		void *child = getChildAt(context, widget, i);
+		struct FlexParams *params = getLayoutParams(context, child);
+		int hasCrossStyleSize = hasStyleSize(features, params, crossAxis);
+		float childBasis = getBasis(context, features, bases, i, child);
 
 		if (remainingSpace < 0) {
-			float flexShrinkScaledFactor = getFlexShrinkFactor(params) * childBasis;
+			float flexShrinkScaledFactor = getFlexShrinkFactor(features, params) * childBasis;
 			if (flexShrinkScaledFactor != 0) childBasis += remainingSpace / totalFlexShrinkScaledFactors * flexShrinkScaledFactor;
 		} else if (remainingSpace > 0) {
-			float flexGrowFactor = getFlexGrowFactor(params);
+			float flexGrowFactor = getFlexGrowFactor(features, params);
 			if (flexGrowFactor != 0) childBasis += remainingSpace / totalFlexGrowFactors * flexGrowFactor;
 		}
 
-		float childCrossSize = isUndefined(childCrossStyleSize) ? availableCross : childCrossStyleSize;
-		enum MeasureMode childCrossMode = !isUndefined(childCrossStyleSize) || (crossMeasureMode == MEASURE_EXACTLY && params->align == ALIGN_STRETCH)
+		float childCrossSize = hasCrossStyleSize ? getStyleSize(params, crossAxis) : availableCross;
+		enum MeasureMode childCrossMode = hasCrossStyleSize || (crossMeasureMode == MEASURE_EXACTLY && params->align == ALIGN_STRETCH)
 			? MEASURE_EXACTLY : crossMeasureMode == MEASURE_UNSPECIFIED ? MEASURE_UNSPECIFIED : MEASURE_AT_MOST;
-		if (mainAxis == DIRECTION_ROW) context->layout(child, childBasis, MEASURE_EXACTLY, childCrossSize, childCrossMode);
-		else context->layout(child, childCrossSize, childCrossMode, childBasis, MEASURE_EXACTLY);
+		if (tasks) {
+			struct FlexTask *task = &tasks[i];
+			task->context = context;
+			task->widget = child;
+			task->width = mainAxis == DIRECTION_ROW ? childBasis : childCrossSize;
+			task->widthMode = mainAxis == DIRECTION_ROW ? MEASURE_EXACTLY : childCrossMode;
+			task->height = mainAxis == DIRECTION_ROW ? childCrossSize : childBasis;
+			task->heightMode = mainAxis == DIRECTION_ROW ? childCrossMode : MEASURE_EXACTLY;
+			task->cost = features & FEATURE_STATE ? getNodeCount(context, child) : 1;
+			task->pass = currentPass;
+#ifdef FLEX_LAYOUT_PROFILE
+			task->depth = currentDepth + 1;
+#endif
+			continue;
+		}
+		if (mainAxis == DIRECTION_ROW) layoutChild(context, features, child, childBasis, MEASURE_EXACTLY, childCrossSize, childCrossMode, 0);
+		else layoutChild(context, features, child, childCrossSize, childCrossMode, childBasis, MEASURE_EXACTLY, 0);
 
 		// Position element in the main axis
-		(mainAxis == DIRECTION_ROW ? context->setX : context->setY)(child, mainSize + getLeadingMargin(params, mainAxis));
-		mainSize += betweenMain + getLayoutSize(context, child, mainAxis) + getMargin(params, mainAxis);
-		crossSize = MAX(crossSize, getLayoutSize(context, child, crossAxis) + getMargin(params, crossAxis));
+		positionInMainAxis(context, features, child, params, mainAxis, betweenMain, &mainSize, &crossSize);
+		if (features & FEATURE_STATE) nodeCount += getNodeCount(context, child);
+	}
+	if (tasks) {
+		runTasks(context, tasks, childCount);
+		for (int i = 0; i < childCount; ++i) {
+			void *child = tasks[i].widget;
+			positionInMainAxis(context, features, child, getLayoutParams(context, child), mainAxis, betweenMain, &mainSize, &crossSize);
+			if (features & FEATURE_STATE) nodeCount += getNodeCount(context, child);
+		}
+		free(tasks);
 	}
+	if (bases >= 0) context->scratch->size = bases;
 
 	// If the dimensions are definite: set them
 	if (mainMeasureMode == MEASURE_EXACTLY) mainSize = availableMain;
@@ -157,29 +784,71 @@ void layoutFlex(const struct FlexContext *context, void *widget, float width, en
 
 	// Position elements in the cross axis
 	for (int i = 0; i < childCount; ++i) {
-		void *child = context->getChildAt(widget, i);
-		struct FlexParams *params = context->getLayoutParams(child);
+		void *child = getChildAt(context, widget, i);
+		struct FlexParams *params = getLayoutParams(context, child);
 		int leadingCrossDim = 0;
 		switch (params->align) {
 			case ALIGN_STRETCH:
 				// Layout the child if the cross size wasn't already definite
 				if (!getStyleSize(params, crossAxis)) {
-					float childWidth = context->getWidth(child), childHeight = context->getHeight(child);
-					*(crossAxis == DIRECTION_ROW ? &childWidth : &childHeight) = crossSize - getMargin(params, crossAxis);
-					context->layout(child, childWidth, MEASURE_EXACTLY, childHeight, MEASURE_EXACTLY);
+					float childWidth = getWidth(context, features, child), childHeight = getHeight(context, features, child);
+					*(crossAxis == DIRECTION_ROW ? &childWidth : &childHeight) = crossSize - getMargin(features, params, crossAxis);
+					layoutChild(context, features, child, childWidth, MEASURE_EXACTLY, childHeight, MEASURE_EXACTLY, 0);
+					++layoutCalls;
 				}
 				break;
 			case ALIGN_CENTER:
 			case ALIGN_END:
-				leadingCrossDim = (crossSize - getLayoutSize(context, child, crossAxis) - getMargin(params, crossAxis)) / (params->align == ALIGN_CENTER ? 2 : 1);
+				leadingCrossDim = (crossSize - getLayoutSize(context, features, child, crossAxis) - getMargin(features, params, crossAxis)) / (params->align == ALIGN_CENTER ? 2 : 1);
 				break;
 			default:
 				break;
 		}
-		(crossAxis == DIRECTION_ROW ? context->setX : context->setY)(child, leadingCrossDim + getLeadingMargin(params, crossAxis));
+		setPosition(context, features, child, crossAxis, leadingCrossDim + getLeadingMargin(params, crossAxis));
 	}
 
 	// Set the implicit width and height
-	context->setWidth(widget, mainAxis == DIRECTION_ROW ? mainSize : crossSize);
-	context->setHeight(widget, mainAxis == DIRECTION_ROW ? crossSize : mainSize);
+	setWidth(context, features, widget, mainAxis == DIRECTION_ROW ? mainSize : crossSize);
+	setHeight(context, features, widget, mainAxis == DIRECTION_ROW ? crossSize : mainSize);
+
+	struct FlexState *state = features & FEATURE_STATE && !measuring ? getPassState(context, widget) : NULL;
+	if (state) {
+		state->nodeCount = nodeCount;
+		if (stats) {
+			state->time += getTime() - startTime;
+			state->layoutCalls += layoutCalls;
+		}
+	}
+#ifdef FLEX_LAYOUT_PROFILE
+	enterSegment(librarySegment.stats, librarySegment.callback);
+#endif
+	PROFILE_END(context, FLEX_SCOPE_CONTAINER, widget, currentDepth);
+	currentContext = outerContext;
+	currentPass = outerPass;
+}
+
+void layoutFlex(const struct FlexContext *context, void *widget, float width, enum MeasureMode widthMode, float height, enum MeasureMode heightMode, enum FlexDirection direction, enum Align justify) {
+	unsigned features = getFeatures(context);
+	if (features) layoutContainer(context, features, widget, width, widthMode, height, heightMode, direction, justify);
+	else layoutContainer(context, 0, widget, width, widthMode, height, heightMode, direction, justify);
+}
+
+int flexMeasure(const struct FlexContext *context, void *widget, float width, enum MeasureMode widthMode, float height, enum MeasureMode heightMode, float *resultWidth, float *resultHeight) {
+	struct MeasureContext measureContext;
+	measureContext.context = *context;
+	measureContext.context.options = (context->options | OPTION_MEASURE) & ~FLEX_OPTION_MERGE_NESTED; // Merging sets sizes directly
+	measureContext.context.scheduler = NULL; // The sizes are recorded on this thread
+	flexTableInit(&measureContext.sizes, sizeof(struct Measured));
+	measureContext.failed = 0;
+
+	unsigned features = getFeatures(&measureContext.context);
+	const struct FlexContext *outerContext = currentContext;
+	currentContext = &measureContext.context;
+	layoutChild(&measureContext.context, features, widget, width, widthMode, height, heightMode, FLEX_DIRTY);
+	*resultWidth = getWidth(&measureContext.context, features, widget);
+	*resultHeight = getHeight(&measureContext.context, features, widget);
+	currentContext = outerContext;
+
+	flexTableDestroy(&measureContext.sizes);
+	return !measureContext.failed;
 }
@@ -1,5 +1,33 @@
 /**
  * Routines for performing layout on flex containers with variable numbers of children.
+ *
+ * <h3>Thread safety</h3>
+ * Besides the widgets it is given, which it touches through the callbacks of
+ * the #FlexContext, #layoutFlex uses the following state of the library:
+ * - Global, updated atomically: the count of layout pass numbers, which each
+ *   thread reserves in blocks for FlexState#pass, and the epoch advanced by
+ *   #flexInvalidateAll. Any thread may call #flexInvalidateAll at any time,
+ *   though layouts already running may cache results computed before it.
+ * - Global, unsynchronized: the active recording of #flexTraceBegin, so only
+ *   one thread may record at a time.
+ * - Thread-local: the context, pass number and, when profiling, depth and
+ *   timed segment of the innermost layout call, see #flexCurrentContext; the
+ *   last pass number used and reserved by the thread; and the items standing
+ *   in for the children of nodes merged by #FLEX_OPTION_MERGE_NESTED. A
+ *   FlexContext#scheduler must therefore lay out its tasks with
+ *   #flexRunTask, which carries the context and pass over to the thread
+ *   running the task.
+ *
+ * Concurrent calls of #layoutFlex, #flexMeasure and #flexRunTask are safe as
+ * long as no widget, #FlexScratch, FlexContext#stateTable or state is used by
+ * two of them at once, while a FlexContext#measureCache may be shared. Without
+ * a scratch buffer #layoutFlex stores the flex basis of each child in its
+ * width while laying out the container, so a widget shared between trees
+ * (e.g. a shared template instance) races even if the callbacks route the
+ * final geometry to per-thread storage. Giving each thread its own copy of
+ * the context with a distinct #FlexScratch removes these intermediate writes;
+ * the library then only calls the setters with final values.
+ *
  * @file
  */
 #ifndef FLEX_LAYOUT_H
@@ -40,6 +68,14 @@ enum MeasureMode {
 	MEASURE_AT_MOST
 };
 
+/** Directions in which to place items. */
+enum FlexDirection {
+	/** The items are layed out horizontally. */
+	DIRECTION_ROW,
+	/** The items are layed out vertically. */
+	DIRECTION_COLUMN
+};
+
 /**
  * Returns whether \c value is undefined.
  *
@@ -48,6 +84,292 @@ enum MeasureMode {
  */
 int isUndefined(const float value);
 
+/**
+ * Per-thread storage for intermediate layout state.
+ *
+ * A scratch buffer must only be used by one thread at a time. Nested
+ * #layoutFlex calls made from within FlexContext#layout on the same thread
+ * may share it; storage is reused in a stack-like fashion.
+ */
+struct FlexScratch {
+	/** The storage, or \c NULL. */
+	float *data;
+	/** The number of floats in use. */
+	int size;
+	/** The number of floats allocated. */
+	int capacity;
+};
+
+/**
+ * Initializes the specified scratch buffer as empty.
+ *
+ * @param scratch The scratch buffer.
+ */
+void flexScratchInit(struct FlexScratch *scratch);
+
+/**
+ * Frees the storage of the specified scratch buffer.
+ *
+ * @param scratch The scratch buffer.
+ */
+void flexScratchDestroy(struct FlexScratch *scratch);
+
+/** Flags of a #FlexState. */
+enum FlexStateFlag {
+	/** The width the widget measures to may have changed since it was last laid out. */
+	FLEX_DIRTY_WIDTH = 1,
+	/** The height the widget measures to may have changed since it was last laid out. */
+	FLEX_DIRTY_HEIGHT = 2,
+	/** The widget changed since it was last laid out, so its cached measurements are stale. */
+	FLEX_DIRTY = FLEX_DIRTY_WIDTH | FLEX_DIRTY_HEIGHT,
+	/** FlexState#layout holds the constraints the subtree is currently laid out with. */
+	FLEX_LAID_OUT = 4
+};
+
+/** The number of measurements cached per widget. */
+#define FLEX_CACHE_SIZE 4
+
+/** A layout of a widget cached by #FLEX_OPTION_CACHE. */
+struct FlexMeasurement {
+	/** The available width. */
+	float width;
+	/** The width requirement. */
+	enum MeasureMode widthMode;
+	/** The available height. */
+	float height;
+	/** The height requirement. */
+	enum MeasureMode heightMode;
+	/** The resulting width. */
+	float resultWidth;
+	/** The resulting height. */
+	float resultHeight;
+};
+
+/** Per-widget state maintained by the library across layout passes. */
+struct FlexState {
+	/** The number of widgets in the subtree as of the last layout, or \c 0 if unknown. */
+	int nodeCount;
+	/** The layout pass that #time refers to, if recorded with #FLEX_OPTION_STATS. */
+	long pass;
+	/** The time in seconds spent laying out the subtree during the last pass. */
+	double time;
+	/** The number of times the widget was laid out by its container during the last pass, not counting cache hits. */
+	int layoutCount;
+	/** The number of times the widget laid out its children during the last pass. */
+	int layoutCalls;
+	/** Combination of #FlexStateFlag values. */
+	int flags;
+	/** The last layout of the widget by its container, valid if #FLEX_LAID_OUT. */
+	struct FlexMeasurement layout;
+	/** The most recent layouts of the widget by its container. */
+	struct FlexMeasurement measurements[FLEX_CACHE_SIZE];
+	/** The number of valid #measurements. */
+	int measurementCount;
+	/** The index in #measurements to store the next layout at. */
+	int nextMeasurement;
+	/** The epoch the cached layouts belong to; they are stale if it is not #flexGetEpoch. */
+	long epoch;
+};
+
+/** Options of a #FlexContext. */
+enum FlexOption {
+	/**
+	 * Skip layouts of children with the constraints of a cached layout.
+	 *
+	 * Requires per-widget state, through FlexContext#getState or
+	 * FlexContext#stateTable. A cached size answers measurements with the
+	 * same constraints, while the layout that positions the descendants is
+	 * skipped only if they are still laid out with the same constraints.
+	 * When a widget changes, it and its ancestors must be marked with
+	 * #flexMarkDirty. Layouts without the option do not maintain the cache,
+	 * so the whole tree must be marked dirty before enabling it again.
+	 */
+	FLEX_OPTION_CACHE = 1,
+	/**
+	 * Lay out nested containers of the same direction as one, see #flexNodeLayout.
+	 *
+	 * Only used for #FlexNode trees, and ignored by #flexMeasure.
+	 */
+	FLEX_OPTION_MERGE_NESTED = 4,
+	/**
+	 * FlexContext#getLayoutParams only returns parameters interned by #flexParamsIntern.
+	 *
+	 * Lets layout read the values derived from the parameters along with them.
+	 */
+	FLEX_OPTION_INTERNED_PARAMS = 8,
+	/**
+	 * Record the statistics of each pass in the #FlexState of the widgets.
+	 *
+	 * FlexState#time, FlexState#layoutCount and FlexState#layoutCalls are only
+	 * kept up to date with this option, as timing every container costs two
+	 * clock reads. Requires per-widget state, see #FLEX_OPTION_CACHE. Passes
+	 * are only numbered, for FlexState#pass, if the root is laid out with the
+	 * option.
+	 */
+	FLEX_OPTION_STATS = 16
+};
+
+struct FlexTable;
+struct FlexMeasureCache;
+
+/** The callbacks of a #FlexContext that time is attributed to in #FlexStats. */
+enum FlexCallback {
+	FLEX_CALLBACK_SET_X,
+	FLEX_CALLBACK_SET_Y,
+	FLEX_CALLBACK_GET_WIDTH,
+	FLEX_CALLBACK_SET_WIDTH,
+	FLEX_CALLBACK_GET_HEIGHT,
+	FLEX_CALLBACK_SET_HEIGHT,
+	FLEX_CALLBACK_LAYOUT,
+	FLEX_CALLBACK_GET_CHILD_COUNT,
+	FLEX_CALLBACK_GET_CHILD_AT,
+	FLEX_CALLBACK_GET_LAYOUT_PARAMS,
+	FLEX_CALLBACK_GET_STATE,
+	FLEX_CALLBACK_ON_LAYOUT_FLEX,
+	FLEX_CALLBACK_GET_CONTENT_HASH,
+	/** The number of callbacks. */
+	FLEX_CALLBACK_COUNT
+};
+
+/**
+ * Where the time of layout was spent, accumulated across passes.
+ *
+ * Only collected if the library is built with \c FLEX_LAYOUT_PROFILE. Times
+ * are exclusive: the time in FlexContext#layout excludes any nested
+ * #layoutFlex call, which counts as library time together with the callbacks
+ * it makes. Waiting for tasks of a FlexContext#scheduler counts as library
+ * time, while the tasks are counted in the stats of the contexts that run
+ * them.
+ */
+struct FlexStats {
+	/** The time in seconds spent in #layoutFlex outside of callbacks. */
+	double libraryTime;
+	/** The number of calls to #layoutFlex. */
+	long libraryCalls;
+	/** The time in seconds spent in each callback, indexed by #FlexCallback. */
+	double callbackTime[FLEX_CALLBACK_COUNT];
+	/** The number of calls to each callback, indexed by #FlexCallback. */
+	long callbackCalls[FLEX_CALLBACK_COUNT];
+};
+
+/**
+ * Clears the specified statistics.
+ *
+ * @param stats The statistics.
+ */
+void flexStatsReset(struct FlexStats *stats);
+
+/**
+ * Adds statistics to others, such as those collected by another thread.
+ *
+ * @param stats The statistics to add to.
+ * @param other The statistics to add.
+ */
+void flexStatsMerge(struct FlexStats *stats, const struct FlexStats *other);
+
+struct FlexContext;
+
+/** The layout of one child subtree, handed to a #FlexScheduler. */
+struct FlexTask {
+	/** The context of the container that spawned the task. */
+	const struct FlexContext *context;
+	/** The child to lay out. */
+	void *widget;
+	/** The width to lay out the child with. */
+	float width;
+	/** The width requirement. */
+	enum MeasureMode widthMode;
+	/** The height to lay out the child with. */
+	float height;
+	/** The height requirement. */
+	enum MeasureMode heightMode;
+	/** The estimated cost: the node count of the subtree in the previous pass, or \c 1 if unknown. */
+	int cost;
+	/** The layout pass the task belongs to. */
+	long pass;
+	/** The depth of the child in the tree, where the root is \c 0, if profiling. */
+	int depth;
+};
+
+/**
+ * Interface to an external job system used to lay out children in parallel.
+ *
+ * The tasks spawned for a container lay out disjoint subtrees and are
+ * independent of each other: they may run in any order and concurrently. The
+ * container waits for all of them before positioning its children.
+ */
+struct FlexScheduler {
+	/** Pointer passed to the callbacks. */
+	void *userData;
+	/**
+	 * Submits the specified task to be run with #flexRunTask.
+	 *
+	 * @param userData #userData.
+	 * @param task The task, valid until it has been waited for.
+	 * @return A handle to pass to #wait, or \c NULL if the task has already run.
+	 */
+	void *(*spawn)(void *userData, struct FlexTask *task);
+	/**
+	 * Blocks until the specified task has run, possibly running other work meanwhile.
+	 *
+	 * @param userData #userData.
+	 * @param handle The handle returned by #spawn.
+	 */
+	void (*wait)(void *userData, void *handle);
+	/** The minimum total cost of the children of a container for them to be laid out in parallel. */
+	int minCost;
+};
+
+/**
+ * Runs the specified task spawned by a #FlexScheduler.
+ *
+ * @param task The task.
+ * @param context The context of the calling thread, or \c NULL to use the
+ * context that spawned the task. Nested layout must use a scratch buffer of
+ * the calling thread.
+ */
+void flexRunTask(const struct FlexTask *task, const struct FlexContext *context);
+
+/** The kinds of scopes reported to a #FlexProfiler. */
+enum FlexScope {
+	/** A call to #layoutFlex for a container. */
+	FLEX_SCOPE_CONTAINER,
+	/** A call to FlexContext#layout for a child. */
+	FLEX_SCOPE_LAYOUT
+};
+
+/**
+ * Hooks for forwarding the scopes of layout to an external profiler.
+ *
+ * The hooks are only called if the library is built with
+ * \c FLEX_LAYOUT_PROFILE defined; otherwise they are compiled out. Each
+ * #begin is matched by an #end on the same thread, with scopes nested
+ * properly. With a FlexContext#scheduler, they may be called concurrently
+ * from the threads running tasks.
+ */
+struct FlexProfiler {
+	/** Pointer passed to the hooks. */
+	void *userData;
+	/**
+	 * Called on entering a scope.
+	 *
+	 * @param userData #userData.
+	 * @param scope The kind of scope.
+	 * @param widget The container being laid out, or the child passed to FlexContext#layout.
+	 * @param depth The depth of \a widget in the tree, where the outermost container is \c 0.
+	 */
+	void (*begin)(void *userData, enum FlexScope scope, const void *widget, int depth);
+	/**
+	 * Called on leaving a scope, with the same arguments as #begin.
+	 *
+	 * @param userData #userData.
+	 * @param scope The kind of scope.
+	 * @param widget The widget of the scope.
+	 * @param depth The depth of the widget.
+	 */
+	void (*end)(void *userData, enum FlexScope scope, const void *widget, int depth);
+};
+
 /** A context specifying an interface to the widgets. */
 struct FlexContext {
 	/**
@@ -124,15 +446,169 @@ struct FlexContext {
 	 * @return The layout parameters.
 	 */
 	void *(*getLayoutParams)(const void *widget);
+	/**
+	 * The scratch buffer for intermediate state or \c NULL.
+	 *
+	 * If \c NULL, intermediate state is stored in the widgets themselves.
+	 * @see FlexScratch
+	 */
+	struct FlexScratch *scratch;
+	/**
+	 * Returns the state of the specified widget maintained by the library, or \c NULL.
+	 *
+	 * May be \c NULL if no state is kept.
+	 *
+	 * @param widget The widget.
+	 * @return The state of the widget.
+	 */
+	struct FlexState *(*getState)(const void *widget);
+	/** The scheduler to lay out children in parallel with, or \c NULL. */
+	const struct FlexScheduler *scheduler;
+	/**
+	 * Returns the x-coordinate set by #setX of the specified widget.
+	 *
+	 * Only used by debugging tools; may be \c NULL.
+	 *
+	 * @param widget The widget.
+	 * @return The x-coordinate of the widget.
+	 */
+	float (*getX)(const void *widget);
+	/**
+	 * Returns the y-coordinate set by #setY of the specified widget.
+	 *
+	 * Only used by debugging tools; may be \c NULL.
+	 *
+	 * @param widget The widget.
+	 * @return The y-coordinate of the widget.
+	 */
+	float (*getY)(const void *widget);
+	/**
+	 * Called by #layoutFlex on entry with its arguments.
+	 *
+	 * Lets tools observe the properties of containers that are otherwise
+	 * only known to #layout. May be \c NULL.
+	 *
+	 * @param widget The flex container.
+	 * @param width The available width.
+	 * @param widthMode The width requirement.
+	 * @param height The available height.
+	 * @param heightMode The height requirement.
+	 * @param direction The direction the items are placed in.
+	 * @param justify The alignment of the content.
+	 */
+	void (*onLayoutFlex)(const void *widget, float width, enum MeasureMode widthMode, float height, enum MeasureMode heightMode, enum FlexDirection direction, enum Align justify);
+	/** The profiler to report scopes to, or \c NULL. Ignored unless built with \c FLEX_LAYOUT_PROFILE. */
+	const struct FlexProfiler *profiler;
+	/**
+	 * The statistics to accumulate the time of layout into, or \c NULL.
+	 *
+	 * Ignored unless built with \c FLEX_LAYOUT_PROFILE. Like #scratch, it must
+	 * not be shared by contexts used concurrently.
+	 */
+	struct FlexStats *stats;
+	/** Combination of #FlexOption values. */
+	unsigned options;
+	/**
+	 * A table of #FlexState values keyed by widget, used if #getState is \c NULL, or \c NULL.
+	 *
+	 * Lets the library keep state for widgets without room for it. Destroyed
+	 * widgets must be removed, lest a new widget at the same address inherit
+	 * their state. Unless every widget already has an entry, layout inserts
+	 * entries and must not run concurrently, e.g. with a #scheduler.
+	 * @see FlexTable
+	 */
+	struct FlexTable *stateTable;
+	/**
+	 * Returns a hash of the content of the specified widget, or \c 0.
+	 *
+	 * A nonzero hash declares the widget a leaf whose layout only sets its
+	 * size, which only depends on the hashed content and the constraints,
+	 * so that widgets with equal hashes may share the measurements in
+	 * #measureCache. May be \c NULL.
+	 *
+	 * @param widget The widget.
+	 * @return The hash of the content.
+	 */
+	unsigned long long (*getContentHash)(const void *widget);
+	/**
+	 * The cache to consult before laying out widgets with a content hash, or \c NULL.
+	 *
+	 * May be shared by contexts used concurrently.
+	 * @see FlexMeasureCache
+	 */
+	struct FlexMeasureCache *measureCache;
+	/**
+	 * The size below which containers are collapsed rather than laid out, or \c 0.
+	 *
+	 * A container whose width and height are both bounded below it, exactly
+	 * or at most, such as a distant world-space panel covering a few pixels,
+	 * is sized as if it had no children, taking its exact sizes and \c 0 in
+	 * the axes without one. Its descendants are given empty rectangles at the
+	 * origin instead. The call is still reported to FlexContext#onLayoutFlex,
+	 * the profiler and the statistics. A container thin in only one axis, such
+	 * as a long divider, is laid out as usual. With #FLEX_OPTION_CACHE,
+	 * #flexInvalidateAll must be called after changing it.
+	 */
+	float minSize;
 };
 
-/** Directions in which to place items. */
-enum FlexDirection {
-	/** The items are layed out horizontally. */
-	DIRECTION_ROW,
-	/** The items are layed out vertically. */
-	DIRECTION_COLUMN
-};
+/**
+ * Returns the context of the innermost #layoutFlex or #flexRunTask call on the calling thread.
+ *
+ * Lets FlexContext#layout lay out nested containers with the same context as
+ * its caller, e.g. with the scratch buffer of the current thread.
+ *
+ * @return The current context, or \c NULL if not within layout.
+ */
+const struct FlexContext *flexCurrentContext(void);
+
+/**
+ * Returns the #FlexState of the specified widget.
+ *
+ * Looks the state up through FlexContext#getState, or else in
+ * FlexContext#stateTable without inserting it.
+ *
+ * @param context The context.
+ * @param widget The widget.
+ * @return The state, or \c NULL if the widget has none.
+ */
+struct FlexState *flexGetState(const struct FlexContext *context, void *widget);
+
+/**
+ * Invalidates all cached layouts and measurements, e.g. as the fonts change.
+ *
+ * Takes constant time by advancing a global epoch: cached entries of earlier
+ * epochs are recomputed as they are next needed.
+ */
+void flexInvalidateAll(void);
+
+/**
+ * Returns the current epoch, advanced by #flexInvalidateAll.
+ *
+ * @return The epoch.
+ */
+long flexGetEpoch(void);
+
+/**
+ * Marks the widget as changed, invalidating its cached layouts.
+ *
+ * Ancestors must be marked as well, since their layout depends on the
+ * widget. A change of the widget may be limited to one axis, such as text
+ * wrapping onto another line at the same width: marking only
+ * #FLEX_DIRTY_HEIGHT keeps the cached widths of the widget, so that rows
+ * measuring it for their basis need not lay it out again. The sizes in the
+ * axis left clean must be unchanged under any constraints. The main size of a
+ * container depends only on the main sizes of its children, so a container
+ * whose children changed only in its cross axis may be marked in that axis
+ * alone. Otherwise a change of the width of a child may change the height of
+ * its container, and vice versa, so it must be marked with #FLEX_DIRTY.
+ * #flexNodeMarkDirty marks the ancestors of a #FlexNode so.
+ *
+ * @param context The context, which must have per-widget state.
+ * @param widget The widget.
+ * @param flags The axes whose sizes may have changed, #FLEX_DIRTY if unsure.
+ */
+void flexMarkDirty(const struct FlexContext *context, void *widget, int flags);
 
 /** Options that control how each individual item is layed out. */
 struct FlexParams {
@@ -176,6 +652,28 @@ struct FlexParams {
  */
 void layoutFlex(const struct FlexContext *context, void *widget, float width, enum MeasureMode widthMode, float height, enum MeasureMode heightMode, enum FlexDirection direction, enum Align justify);
 
+/**
+ * Returns the size the specified widget would have under the constraints, without changing it.
+ *
+ * Lays out the subtree as FlexContext#layout would, but records the sizes in
+ * a temporary table rather than setting them, and sets no positions, e.g.
+ * to try several constraints for placing a popup. Cached layouts and the
+ * FlexContext#measureCache are consulted, but only the latter is updated.
+ * FlexContext#layout must lay out nested containers with the context of
+ * #flexCurrentContext, while leaves it measures have their size reverted.
+ *
+ * @param context The context to use, whose scheduler is ignored.
+ * @param widget The widget.
+ * @param width The available width.
+ * @param widthMode The width requirement.
+ * @param height The available height.
+ * @param heightMode The height requirement.
+ * @param resultWidth Set to the width of the widget.
+ * @param resultHeight Set to the height of the widget.
+ * @return Whether the size was measured; \c 0 if out of memory.
+ */
+int flexMeasure(const struct FlexContext *context, void *widget, float width, enum MeasureMode widthMode, float height, enum MeasureMode heightMode, float *resultWidth, float *resultHeight);
+
 #ifdef __cplusplus
 }
 #endif
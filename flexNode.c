@@ -0,0 +1,319 @@
+#include "flexNode.h"
+#include <stdlib.h>
+
+#ifdef _MSC_VER
+#define FLEX_THREAD_LOCAL __declspec(thread)
+#else
+#define FLEX_THREAD_LOCAL __thread
+#endif
+
+static void setX(const void *widget, float x) {
+	((struct FlexNode *) widget)->x = x;
+}
+
+static void setY(const void *widget, float y) {
+	((struct FlexNode *) widget)->y = y;
+}
+
+static float getX(const void *widget) {
+	return ((const struct FlexNode *) widget)->x;
+}
+
+static float getY(const void *widget) {
+	return ((const struct FlexNode *) widget)->y;
+}
+
+static float getWidth(const void *widget) {
+	return ((const struct FlexNode *) widget)->width;
+}
+
+static void setWidth(const void *widget, float width) {
+	((struct FlexNode *) widget)->width = width;
+}
+
+static float getHeight(const void *widget) {
+	return ((const struct FlexNode *) widget)->height;
+}
+
+static void setHeight(const void *widget, float height) {
+	((struct FlexNode *) widget)->height = height;
+}
+
+static void layout(const void *widget, float width, enum MeasureMode widthMode, float height, enum MeasureMode heightMode) {
+	const struct FlexContext *context = flexCurrentContext();
+	flexNodeLayout(context ? context : &flexNodeContext, (struct FlexNode *) widget, width, widthMode, height, heightMode);
+}
+
+static int getChildCount(const void *widget) {
+	return ((const struct FlexNode *) widget)->childCount;
+}
+
+static void *getChildAt(const void *widget, int index) {
+	return ((const struct FlexNode *) widget)->children[index];
+}
+
+static void *getLayoutParams(const void *widget) {
+	return &((struct FlexNode *) widget)->params;
+}
+
+static struct FlexState *getState(const void *widget) {
+	return &((struct FlexNode *) widget)->state;
+}
+
+const struct FlexContext flexNodeContext = {
+	.setX = setX,
+	.setY = setY,
+	.getWidth = getWidth,
+	.setWidth = setWidth,
+	.getHeight = getHeight,
+	.setHeight = setHeight,
+	.layout = layout,
+	.getChildCount = getChildCount,
+	.getChildAt = getChildAt,
+	.getLayoutParams = getLayoutParams,
+	.getState = getState,
+	.getX = getX,
+	.getY = getY
+};
+
+void flexNodeInit(struct FlexNode *node) {
+	node->params.align = ALIGN_START;
+	node->params.flex = 0;
+	node->params.width = node->params.height = UNDEFINED;
+	node->params.marginTop = node->params.marginRight = node->params.marginBottom = node->params.marginLeft = 0;
+	node->direction = DIRECTION_ROW;
+	node->justify = ALIGN_START;
+	node->measure = NULL;
+	node->userData = NULL;
+	node->parent = NULL;
+	node->children = NULL;
+	node->childCount = node->childCapacity = 0;
+	node->x = node->y = node->width = node->height = 0;
+	node->state.nodeCount = 1;
+	node->state.pass = 0;
+	node->state.time = 0;
+	node->state.layoutCount = node->state.layoutCalls = 0;
+	node->state.flags = 0;
+	node->state.measurementCount = node->state.nextMeasurement = 0;
+	node->state.epoch = 0;
+	node->mergeable = -1;
+	node->mergedItemCount = 0;
+}
+
+void flexNodeDestroy(struct FlexNode *node) {
+	if (node->parent) flexNodeRemoveChild(node->parent, node);
+	while (node->childCount) flexNodeRemoveChild(node, node->children[node->childCount - 1]);
+	free(node->children);
+	node->children = NULL;
+	node->childCapacity = 0;
+}
+
+/** Adds \a count to the node count of the node and its ancestors. */
+static void addNodeCount(struct FlexNode *node, int count) {
+	for (; node; node = node->parent) node->state.nodeCount += count;
+}
+
+int flexNodeInsertChild(struct FlexNode *node, struct FlexNode *child, int index) {
+	if (node->childCount == node->childCapacity) {
+		int capacity = node->childCapacity ? 2 * node->childCapacity : 4;
+		struct FlexNode **children = realloc(node->children, capacity * sizeof *children);
+		if (!children) return 0;
+		node->children = children;
+		node->childCapacity = capacity;
+	}
+	for (int i = node->childCount; i > index; --i) node->children[i] = node->children[i - 1];
+	node->children[index] = child;
+	++node->childCount;
+	child->parent = node;
+	addNodeCount(node, child->state.nodeCount);
+	flexNodeMarkDirty(node, FLEX_DIRTY);
+	return 1;
+}
+
+void flexNodeRemoveChild(struct FlexNode *node, struct FlexNode *child) {
+	int index = 0;
+	while (index < node->childCount && node->children[index] != child) ++index;
+	if (index == node->childCount) return;
+	for (int i = index; i < node->childCount - 1; ++i) node->children[i] = node->children[i + 1];
+	--node->childCount;
+	child->parent = NULL;
+	addNodeCount(node, -child->state.nodeCount);
+	flexNodeMarkDirty(node, FLEX_DIRTY);
+}
+
+void flexNodeMarkDirty(struct FlexNode *node, int flags) {
+	flags &= FLEX_DIRTY;
+	node->state.flags |= flags;
+	node->mergeable = -1;
+	// Go all the way up, as containers that skip laying out their children may be clean above dirty ones
+	for (node = node->parent; node; node = node->parent) {
+		// The main size of a container is that of its items in the main axis, so only a change across them keeps it.
+		// Any other changes the space left to the items, and so their sizes in both axes.
+		if (flags & ~(node->direction == DIRECTION_ROW ? FLEX_DIRTY_HEIGHT : FLEX_DIRTY_WIDTH)) flags = FLEX_DIRTY;
+		node->state.flags |= flags;
+		node->mergeable = -1; // Depends on the descendants merged into the node
+	}
+}
+
+/** Returns whether the size is a whole number, which layout accumulates without truncation. */
+static int isWhole(float size) {
+	return size > -16777216 && size < 16777216 && (int) size == size;
+}
+
+/**
+ * Returns whether the child of a container in the direction lays out the same as its children would in its place.
+ *
+ * Kept on the node along with the number of its items until #flexNodeMarkDirty marks it or a descendant, so that
+ * layouts need not visit the subtree again.
+ */
+static int isMergeable(struct FlexNode *node, enum FlexDirection direction) {
+	if (node->direction != direction) return 0;
+	if (node->mergeable >= 0) return node->mergeable;
+	node->mergeable = 0;
+	const struct FlexParams *params = &node->params;
+	if (node->measure || !node->childCount || node->justify != ALIGN_START
+			|| params->align != ALIGN_STRETCH || params->flex != 0 || !isUndefined(params->width) || !isUndefined(params->height)
+			|| params->marginTop || params->marginRight || params->marginBottom || params->marginLeft) {
+		return 0;
+	}
+	// The children must have the same final constraints either way, so may not depend on the space of the node
+	int count = 0;
+	for (int i = 0; i < node->childCount; ++i) {
+		struct FlexNode *child = node->children[i];
+		const struct FlexParams *childParams = &child->params;
+		if (childParams->flex != 0) return 0;
+		if (isMergeable(child, direction)) {
+			count += child->mergedItemCount;
+			continue;
+		}
+		if (direction == DIRECTION_ROW
+				? !isWhole(childParams->width) || !isWhole(childParams->marginLeft) || !isWhole(childParams->marginRight)
+				: !isWhole(childParams->height) || !isWhole(childParams->marginTop) || !isWhole(childParams->marginBottom)) {
+			return 0;
+		}
+		++count;
+	}
+	node->mergedItemCount = count;
+	return node->mergeable = 1;
+}
+
+/** Stores the items that the children of the node are merged into at \a items, returning the end of them. */
+static struct FlexNode **collectItems(struct FlexNode *node, enum FlexDirection direction, struct FlexNode **items) {
+	for (int i = 0; i < node->childCount; ++i) {
+		struct FlexNode *child = node->children[i];
+		if (isMergeable(child, direction)) items = collectItems(child, direction, items);
+		else *items++ = child;
+	}
+	return items;
+}
+
+static float *getPosition(struct FlexNode *node, enum FlexDirection axis) {
+	return axis == DIRECTION_ROW ? &node->x : &node->y;
+}
+
+static float *getSize(struct FlexNode *node, enum FlexDirection axis) {
+	return axis == DIRECTION_ROW ? &node->width : &node->height;
+}
+
+/**
+ * Sizes and positions a merged container around its children, laid out as items of an ancestor.
+ *
+ * Sets the geometry that #layoutFlex would have, and makes the positions of
+ * the children relative to the container.
+ * @param crossSize The size of the ancestor in the cross axis, to which the container is stretched.
+ */
+static void placeMerged(struct FlexNode *node, enum FlexDirection direction, float crossSize) {
+	int mainSize = 0; // Accumulated as by layoutFlex
+	for (int i = 0; i < node->childCount; ++i) {
+		struct FlexNode *child = node->children[i];
+		if (isMergeable(child, direction)) placeMerged(child, direction, crossSize);
+		mainSize += *getSize(child, direction) + (direction == DIRECTION_ROW
+				? child->params.marginLeft + child->params.marginRight : child->params.marginTop + child->params.marginBottom);
+	}
+	struct FlexNode *first = node->children[0];
+	float position = *getPosition(first, direction) - (direction == DIRECTION_ROW ? first->params.marginLeft : first->params.marginTop);
+	for (int i = 0; i < node->childCount; ++i) *getPosition(node->children[i], direction) -= position;
+	*getPosition(node, direction) = position;
+	*getPosition(node, direction == DIRECTION_ROW ? DIRECTION_COLUMN : DIRECTION_ROW) = 0;
+	*getSize(node, direction) = mainSize;
+	*getSize(node, direction == DIRECTION_ROW ? DIRECTION_COLUMN : DIRECTION_ROW) = crossSize;
+	// The container was laid out anew, as a part of its ancestor
+	node->state.flags &= ~(FLEX_DIRTY | FLEX_LAID_OUT);
+	node->state.measurementCount = node->state.nextMeasurement = 0;
+}
+
+/** The items of a node laid out by #layoutMerged on this thread, which stand in for its children. */
+struct MergedItems {
+	const struct FlexNode *node;
+	struct FlexNode **items;
+	int count;
+	/** The items of an ancestor being laid out by #layoutMerged, or \c NULL. */
+	struct MergedItems *outer;
+};
+
+static FLEX_THREAD_LOCAL struct MergedItems *mergedItems;
+
+/** Returns the items that stand in for the children of the widget, or \c NULL if not merged. */
+static const struct MergedItems *findMergedItems(const void *widget) {
+	struct MergedItems *merged = mergedItems;
+	while (merged && merged->node != widget) merged = merged->outer;
+	return merged;
+}
+
+static int getMergedChildCount(const void *widget) {
+	const struct MergedItems *merged = findMergedItems(widget);
+	return merged ? merged->count : getChildCount(widget);
+}
+
+static void *getMergedChildAt(const void *widget, int index) {
+	const struct MergedItems *merged = findMergedItems(widget);
+	return merged ? merged->items[index] : getChildAt(widget, index);
+}
+
+/** Lays out the node with the children of mergeable containers in their place, returning whether it could. */
+static int layoutMerged(const struct FlexContext *context, struct FlexNode *node, float width, enum MeasureMode widthMode, float height, enum MeasureMode heightMode) {
+	enum FlexDirection direction = node->direction;
+	if ((direction == DIRECTION_ROW ? heightMode : widthMode) != MEASURE_EXACTLY
+			|| node->justify == ALIGN_SPACE_BETWEEN || node->justify == ALIGN_SPACE_AROUND) {
+		return 0;
+	}
+	int mergeable = 0, count = 0;
+	for (int i = 0; i < node->childCount; ++i) {
+		struct FlexNode *child = node->children[i];
+		if (isMergeable(child, direction)) {
+			mergeable = 1;
+			count += child->mergedItemCount;
+		} else {
+			++count;
+		}
+	}
+	if (!mergeable) return 0;
+	struct MergedItems merged = { node, NULL, count, mergedItems };
+	if (!(merged.items = malloc(merged.count * sizeof *merged.items))) return 0;
+	collectItems(node, direction, merged.items);
+
+	// Lay out the items as the children of the node without changing the tree, only this thread lays out the node itself
+	struct FlexContext mergedContext = *context;
+	mergedContext.getChildCount = getMergedChildCount;
+	mergedContext.getChildAt = getMergedChildAt;
+	int nodeCount = node->state.nodeCount;
+	mergedItems = &merged;
+	layoutFlex(&mergedContext, node, width, widthMode, height, heightMode, direction, node->justify);
+	mergedItems = merged.outer;
+	node->state.nodeCount = nodeCount;
+	free(merged.items);
+
+	float crossSize = direction == DIRECTION_ROW ? node->height : node->width;
+	for (int i = 0; i < node->childCount; ++i) {
+		if (isMergeable(node->children[i], direction)) placeMerged(node->children[i], direction, crossSize);
+	}
+	return 1;
+}
+
+void flexNodeLayout(const struct FlexContext *context, struct FlexNode *node, float width, enum MeasureMode widthMode, float height, enum MeasureMode heightMode) {
+	if (!context) context = &flexNodeContext;
+	if (node->measure) node->measure(node, width, widthMode, height, heightMode);
+	else if (!(context->options & FLEX_OPTION_MERGE_NESTED && layoutMerged(context, node, width, widthMode, height, heightMode))) {
+		layoutFlex(context, node, width, widthMode, height, heightMode, node->direction, node->justify);
+	}
+}
@@ -0,0 +1,147 @@
+/**
+ * A retained tree of flex nodes laid out with #layoutFlex.
+ *
+ * For users without a widget hierarchy of their own, or who want the library
+ * to keep track of the tree. Nodes are allocated by the caller and linked
+ * together with #flexNodeInsertChild.
+ * @file
+ */
+#ifndef FLEX_NODE_H
+#define FLEX_NODE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "flexLayout.h"
+
+/** A node in a flex tree. */
+struct FlexNode {
+	/** The layout parameters of the node. */
+	struct FlexParams params;
+	/** The direction the children are placed in. */
+	enum FlexDirection direction;
+	/** The alignment of the children in the main axis. */
+	enum Align justify;
+	/**
+	 * Measures the leaf node by setting its #width and #height, or \c NULL if the node is a container.
+	 *
+	 * @param node The node.
+	 * @param width The available width.
+	 * @param widthMode The width requirement.
+	 * @param height The available height.
+	 * @param heightMode The height requirement.
+	 */
+	void (*measure)(struct FlexNode *node, float width, enum MeasureMode widthMode, float height, enum MeasureMode heightMode);
+	/** Pointer for use by the application. */
+	void *userData;
+	/** The parent, or \c NULL if the node is a root. */
+	struct FlexNode *parent;
+	/** The children. */
+	struct FlexNode **children;
+	/** The number of children. */
+	int childCount;
+	/** The number of children allocated. */
+	int childCapacity;
+	/** The computed x-coordinate relative to the parent. */
+	float x;
+	/** The computed y-coordinate relative to the parent. */
+	float y;
+	/** The computed width. */
+	float width;
+	/** The computed height. */
+	float height;
+	/**
+	 * The layout state of the node.
+	 *
+	 * FlexState#nodeCount is kept up to date as the tree is modified.
+	 */
+	struct FlexState state;
+	/** Whether the node can be merged into a parent of its direction by #FLEX_OPTION_MERGE_NESTED, or \c -1 if unknown. */
+	int mergeable;
+	/** The number of items the children of the node are merged into, if #mergeable. */
+	int mergedItemCount;
+};
+
+/** A context for laying out #FlexNode trees. */
+extern const struct FlexContext flexNodeContext;
+
+/**
+ * Initializes the specified node as a root without children.
+ *
+ * @param node The node.
+ */
+void flexNodeInit(struct FlexNode *node);
+
+/**
+ * Detaches the node from its parent and children and frees its storage.
+ *
+ * @param node The node.
+ */
+void flexNodeDestroy(struct FlexNode *node);
+
+/**
+ * Inserts a root node as a child at the specified index.
+ *
+ * @param node The parent.
+ * @param child The root node to insert.
+ * @param index The index to insert at, between \c 0 and the child count.
+ * @return Whether the child was inserted; \c 0 if out of memory.
+ */
+int flexNodeInsertChild(struct FlexNode *node, struct FlexNode *child, int index);
+
+/**
+ * Removes the specified child, making it a root.
+ *
+ * @param node The parent.
+ * @param child The child to remove.
+ */
+void flexNodeRemoveChild(struct FlexNode *node, struct FlexNode *child);
+
+/**
+ * Marks the node and its ancestors as changed, for #FLEX_OPTION_CACHE and
+ * #FLEX_OPTION_MERGE_NESTED.
+ *
+ * Must be called after modifying the layout parameters, direction, justify or
+ * #measure of the node, or anything its #measure depends on. Inserting and removing
+ * children marks the parent. Changes of the parameters, direction or justify
+ * must be marked with #FLEX_DIRTY, only changes of the content may be limited
+ * to one axis. An ancestor is marked in its cross axis alone if the change
+ * below it is limited to that axis, as its size in the main axis depends only
+ * on the sizes of its items in that axis. It is marked in both axes otherwise.
+ *
+ * @param node The node.
+ * @param flags The axes whose sizes may have changed, see #flexMarkDirty.
+ */
+void flexNodeMarkDirty(struct FlexNode *node, int flags);
+
+/**
+ * Lays out the tree rooted at the specified node.
+ *
+ * With #FLEX_OPTION_MERGE_NESTED, a container whose cross size is exact lays
+ * out the children of nested containers as its own, skipping a measurement
+ * pass per level of nesting. The nested containers must have the same
+ * direction, start justification and at least one child, and be stretched
+ * without flex, size or margins. Their children must have no flex and be
+ * either such containers or have whole sizes and margins in the main axis, so
+ * that they are laid out with the same constraints either way. The nested
+ * containers are then sized and positioned around their children. The
+ * container must not justify its content with space between the items. The
+ * tree is not modified while merging, and the layout is the same as
+ * without merging.
+ *
+ * @param context The context to use, a copy of #flexNodeContext that may
+ * specify additional options, or \c NULL to use #flexNodeContext.
+ * @param node The root node.
+ * @param width The available width.
+ * @param widthMode The width requirement.
+ * @param height The available height.
+ * @param heightMode The height requirement.
+ */
+void flexNodeLayout(const struct FlexContext *context, struct FlexNode *node, float width, enum MeasureMode widthMode, float height, enum MeasureMode heightMode);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
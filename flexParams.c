@@ -0,0 +1,67 @@
+#include "flexParams.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+static size_t hashParams(const struct FlexParams *params) {
+	const unsigned char *bytes = (const unsigned char *) params;
+	uint64_t hash = 0xCBF29CE484222325ULL; // FNV-1a
+	for (size_t i = 0; i < sizeof *params; ++i) hash = (hash ^ bytes[i]) * 0x100000001B3ULL;
+	return (size_t) (hash ^ hash >> 32);
+}
+
+void flexParamsPoolInit(struct FlexParamsPool *pool) {
+	pool->slots = NULL;
+	pool->capacity = pool->count = 0;
+}
+
+void flexParamsPoolDestroy(struct FlexParamsPool *pool) {
+	for (size_t i = 0; i < pool->capacity; ++i) free(pool->slots[i]);
+	free(pool->slots);
+	flexParamsPoolInit(pool);
+}
+
+/** Returns the slot holding the parameters, or the empty slot where they would be inserted. */
+static struct FlexInternedParams **probe(const struct FlexParamsPool *pool, const struct FlexParams *params) {
+	for (size_t i = hashParams(params) & (pool->capacity - 1);; i = (i + 1) & (pool->capacity - 1)) {
+		struct FlexInternedParams **slot = pool->slots + i;
+		if (!*slot || !memcmp(&(*slot)->params, params, sizeof *params)) return slot;
+	}
+}
+
+static int grow(struct FlexParamsPool *pool) {
+	struct FlexParamsPool old = *pool;
+	pool->capacity = old.capacity ? 2 * old.capacity : 16;
+	if (!(pool->slots = calloc(pool->capacity, sizeof *pool->slots))) {
+		*pool = old;
+		return 0;
+	}
+	for (size_t i = 0; i < old.capacity; ++i) {
+		if (old.slots[i]) *probe(pool, &old.slots[i]->params) = old.slots[i];
+	}
+	free(old.slots);
+	return 1;
+}
+
+struct FlexParams *flexParamsIntern(struct FlexParamsPool *pool, const struct FlexParams *params) {
+	struct FlexInternedParams **slot = pool->capacity ? probe(pool, params) : NULL;
+	if (slot && *slot) return &(*slot)->params;
+	// Only grow when inserting, so that interning present parameters cannot fail
+	if (4 * (pool->count + 1) > 3 * pool->capacity) {
+		if (!grow(pool)) return NULL;
+		slot = probe(pool, params);
+	}
+	struct FlexInternedParams *interned = malloc(sizeof *interned);
+	if (!interned) return NULL;
+	interned->params = *params;
+	// Derived as by layoutFlex
+	interned->margins[DIRECTION_ROW] = params->marginLeft + params->marginRight;
+	interned->margins[DIRECTION_COLUMN] = params->marginTop + params->marginBottom;
+	interned->hasSize[DIRECTION_ROW] = !isUndefined(params->width);
+	interned->hasSize[DIRECTION_COLUMN] = !isUndefined(params->height);
+	interned->growFactor = params->flex > 0 ? params->flex : 0;
+	interned->shrinkFactor = params->flex < 0;
+	*slot = interned;
+	++pool->count;
+	return &interned->params;
+}
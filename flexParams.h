@@ -0,0 +1,76 @@
+/**
+ * Layout parameters interned to be shared between widgets.
+ *
+ * Widgets with equal parameters may all point to one immutable copy kept in
+ * a #FlexParamsPool, saving memory. Each copy also holds values derived from
+ * the parameters, which layout reads instead of recomputing them for every
+ * child once the context declares #FLEX_OPTION_INTERNED_PARAMS.
+ * @file
+ */
+#ifndef FLEX_PARAMS_H
+#define FLEX_PARAMS_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "flexLayout.h"
+#include <stddef.h>
+
+/** Layout parameters interned by #flexParamsIntern, with values derived from them. */
+struct FlexInternedParams {
+	/** The parameters, which must not be modified. */
+	struct FlexParams params;
+	/** The sum of the leading and trailing margins, indexed by #FlexDirection. */
+	float margins[2];
+	/** Whether the width and height are defined, indexed by #FlexDirection. */
+	int hasSize[2];
+	/** The factor of the free space to grow by. */
+	float growFactor;
+	/** The factor of the overflow to shrink by, scaled by the basis. */
+	int shrinkFactor;
+};
+
+/** A set of interned layout parameters. */
+struct FlexParamsPool {
+	/** Open-addressing table of the interned parameters, with \c NULL for empty slots. */
+	struct FlexInternedParams **slots;
+	/** The number of slots, a power of two or \c 0. */
+	size_t capacity;
+	/** The number of interned parameters. */
+	size_t count;
+};
+
+/**
+ * Initializes the specified pool as empty.
+ *
+ * @param pool The pool.
+ */
+void flexParamsPoolInit(struct FlexParamsPool *pool);
+
+/**
+ * Frees the interned parameters of the specified pool, which must no longer be used.
+ *
+ * @param pool The pool.
+ */
+void flexParamsPoolDestroy(struct FlexParamsPool *pool);
+
+/**
+ * Returns the interned copy of the specified parameters, interning them if new.
+ *
+ * Parameters are equal if they have the same bits. The copy stays at the same
+ * address until the pool is destroyed, and is returned for all equal
+ * parameters. Interning must not run concurrently with other calls on the
+ * pool, while the copies may be read concurrently.
+ *
+ * @param pool The pool.
+ * @param params The parameters.
+ * @return The interned parameters, or \c NULL if out of memory.
+ */
+struct FlexParams *flexParamsIntern(struct FlexParamsPool *pool, const struct FlexParams *params);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
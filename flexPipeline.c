@@ -0,0 +1,295 @@
+#include "flexPipeline.h"
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#define compareExchange(target, expected, value) _InterlockedCompareExchange(target, value, expected)
+#define pauseProcessor() _mm_pause()
+#else
+#define compareExchange(target, expected, value) __sync_val_compare_and_swap(target, expected, value)
+#if defined(__i386__) || defined(__x86_64__)
+#define pauseProcessor() __builtin_ia32_pause()
+#elif defined(__aarch64__)
+#define pauseProcessor() __asm__ __volatile__("yield")
+#else
+#define pauseProcessor() ((void) 0)
+#endif
+#endif
+#ifdef _WIN32
+#include <windows.h>
+#define yieldThread() SwitchToThread()
+#else
+#include <sched.h>
+#define yieldThread() sched_yield()
+#endif
+
+/** The number of failed attempts to take the lock before yielding the processor. */
+#define SPIN_COUNT 64
+
+/** Atomically replaces the target with the value, returning the old value. */
+static long exchange(volatile long *target, long value) {
+	long old = 0, seen;
+	while ((seen = compareExchange(target, old, value)) != old) old = seen;
+	return old;
+}
+
+/** The flag of FlexPipeline#ready set when results are published and cleared when they are acquired. */
+#define FRESH 4
+
+/** Acquires the lock of the pending mutations, spinning since it is only held briefly, and yielding in case the holder was preempted. */
+static void lockPending(struct FlexPipeline *pipeline) {
+	for (int spins = 0; exchange(&pipeline->lock, 1);) {
+		if (++spins < SPIN_COUNT) {
+			pauseProcessor();
+		} else {
+			yieldThread();
+			spins = 0;
+		}
+	}
+}
+
+static void unlockPending(struct FlexPipeline *pipeline) {
+	exchange(&pipeline->lock, 0);
+}
+
+static void initQueue(struct FlexMutationQueue *queue) {
+	queue->mutations = NULL;
+	queue->count = queue->capacity = 0;
+}
+
+/** Makes room for the specified number of mutations. */
+static int reserve(struct FlexMutationQueue *queue, int count) {
+	if (count <= queue->capacity) return 1;
+	int capacity = queue->capacity ? queue->capacity : 16;
+	while (capacity < count) capacity *= 2;
+	struct FlexMutation *mutations = realloc(queue->mutations, capacity * sizeof *mutations);
+	if (!mutations) return 0;
+	queue->mutations = mutations;
+	queue->capacity = capacity;
+	return 1;
+}
+
+static void swapQueues(struct FlexMutationQueue *a, struct FlexMutationQueue *b) {
+	struct FlexMutationQueue queue = *a;
+	*a = *b;
+	*b = queue;
+}
+
+static void initResults(struct FlexPipelineResults *results) {
+	results->x = results->y = results->width = results->height = NULL;
+	results->nodeCount = results->capacity = 0;
+	results->frame = 0;
+	results->failed = 0;
+}
+
+void flexPipelineInit(struct FlexPipeline *pipeline) {
+	pipeline->context = flexNodeContext;
+	pipeline->context.options |= FLEX_OPTION_CACHE;
+	pipeline->wake = NULL;
+	pipeline->userData = NULL;
+	initQueue(&pipeline->queue);
+	pipeline->submitted = 0;
+	pipeline->front = 0;
+	pipeline->lock = 0;
+	initQueue(&pipeline->pending);
+	pipeline->pendingFrame = 0;
+	pipeline->ready = 1;
+	for (int i = 0; i < 3; ++i) initResults(pipeline->results + i);
+	initQueue(&pipeline->applying);
+	pipeline->nodes = NULL;
+	pipeline->nodeCapacity = 0;
+	pipeline->frame = 0;
+	pipeline->failed = 0;
+	pipeline->back = 2;
+}
+
+static void destroyNode(struct FlexPipeline *pipeline, int id) {
+	flexNodeDestroy(&pipeline->nodes[id]->node);
+	free(pipeline->nodes[id]);
+	pipeline->nodes[id] = NULL;
+}
+
+void flexPipelineDestroy(struct FlexPipeline *pipeline) {
+	for (int i = 0; i < pipeline->nodeCapacity; ++i) {
+		if (pipeline->nodes[i]) destroyNode(pipeline, i);
+	}
+	free(pipeline->nodes);
+	free(pipeline->queue.mutations);
+	free(pipeline->pending.mutations);
+	free(pipeline->applying.mutations);
+	for (int i = 0; i < 3; ++i) free(pipeline->results[i].x);
+	flexPipelineInit(pipeline);
+}
+
+int flexPipelinePush(struct FlexPipeline *pipeline, const struct FlexMutation *mutation) {
+	struct FlexMutationQueue *queue = &pipeline->queue;
+	if (!reserve(queue, queue->count + 1)) return 0;
+	queue->mutations[queue->count++] = *mutation;
+	return 1;
+}
+
+int flexPipelineSubmit(struct FlexPipeline *pipeline) {
+	struct FlexMutationQueue *queue = &pipeline->queue, *pending = &pipeline->pending;
+	int success = 1;
+	lockPending(pipeline);
+	if (!pending->count) {
+		// The layout thread has caught up: hand over the storage as is
+		swapQueues(queue, pending);
+	} else if ((success = reserve(pending, pending->count + queue->count))) {
+		memcpy(pending->mutations + pending->count, queue->mutations, queue->count * sizeof *queue->mutations);
+		pending->count += queue->count;
+	}
+	if (success) pipeline->pendingFrame = ++pipeline->submitted;
+	unlockPending(pipeline);
+	if (!success) return 0;
+	queue->count = 0;
+	if (pipeline->wake) pipeline->wake(pipeline->userData);
+	return 1;
+}
+
+static struct FlexPipelineNode *getNode(const struct FlexPipeline *pipeline, int id) {
+	return id >= 0 && id < pipeline->nodeCapacity ? pipeline->nodes[id] : NULL;
+}
+
+static void measureContent(struct FlexNode *node, float width, enum MeasureMode widthMode, float height, enum MeasureMode heightMode) {
+	const struct FlexPipelineNode *pipelineNode = (struct FlexPipelineNode *) node;
+	float contentWidth = pipelineNode->contentWidth, contentHeight = pipelineNode->contentHeight;
+	node->width = widthMode == MEASURE_EXACTLY || (widthMode == MEASURE_AT_MOST && contentWidth > width) ? width : contentWidth;
+	node->height = heightMode == MEASURE_EXACTLY || (heightMode == MEASURE_AT_MOST && contentHeight > height) ? height : contentHeight;
+}
+
+static int createNode(struct FlexPipeline *pipeline, int id) {
+	if (id >= pipeline->nodeCapacity) {
+		int capacity = pipeline->nodeCapacity ? pipeline->nodeCapacity : 16;
+		while (capacity <= id) capacity *= 2;
+		struct FlexPipelineNode **nodes = realloc(pipeline->nodes, capacity * sizeof *nodes);
+		if (!nodes) return 0;
+		for (int i = pipeline->nodeCapacity; i < capacity; ++i) nodes[i] = NULL;
+		pipeline->nodes = nodes;
+		pipeline->nodeCapacity = capacity;
+	}
+	struct FlexPipelineNode *node = malloc(sizeof *node);
+	if (!node) return 0;
+	flexNodeInit(&node->node);
+	node->contentWidth = node->contentHeight = 0;
+	node->root = 0;
+	pipeline->nodes[id] = node;
+	return 1;
+}
+
+static int isAncestor(const struct FlexNode *node, const struct FlexNode *descendant) {
+	for (; descendant; descendant = descendant->parent) {
+		if (descendant == node) return 1;
+	}
+	return 0;
+}
+
+static void apply(struct FlexPipeline *pipeline, const struct FlexMutation *mutation) {
+	struct FlexPipelineNode *node = getNode(pipeline, mutation->node), *child;
+	if (mutation->type == FLEX_MUTATION_CREATE) {
+		if (!node && mutation->node >= 0 && !createNode(pipeline, mutation->node)) pipeline->failed = 1;
+		return;
+	}
+	if (!node) return;
+	switch (mutation->type) {
+		case FLEX_MUTATION_DESTROY:
+			destroyNode(pipeline, mutation->node);
+			break;
+		case FLEX_MUTATION_INSERT_CHILD:
+			if ((child = getNode(pipeline, mutation->child)) && !child->node.parent && !isAncestor(&child->node, &node->node)) {
+				int index = mutation->index < 0 ? 0 : mutation->index > node->node.childCount ? node->node.childCount : mutation->index;
+				if (!flexNodeInsertChild(&node->node, &child->node, index)) pipeline->failed = 1;
+			}
+			break;
+		case FLEX_MUTATION_REMOVE_CHILD:
+			if ((child = getNode(pipeline, mutation->child)) && child->node.parent == &node->node) flexNodeRemoveChild(&node->node, &child->node);
+			break;
+		case FLEX_MUTATION_SET_PARAMS:
+			node->node.params = mutation->params;
+			flexNodeMarkDirty(&node->node, FLEX_DIRTY);
+			break;
+		case FLEX_MUTATION_SET_CONTAINER:
+			node->node.direction = mutation->direction;
+			node->node.justify = mutation->justify;
+			flexNodeMarkDirty(&node->node, FLEX_DIRTY);
+			break;
+		case FLEX_MUTATION_SET_CONTENT: {
+			int flags = node->node.measure ? 0 : FLEX_DIRTY;
+			if (node->contentWidth != mutation->width) flags |= FLEX_DIRTY_WIDTH;
+			if (node->contentHeight != mutation->height) flags |= FLEX_DIRTY_HEIGHT;
+			node->node.measure = measureContent;
+			node->contentWidth = mutation->width;
+			node->contentHeight = mutation->height;
+			if (flags) flexNodeMarkDirty(&node->node, flags);
+			break;
+		}
+		case FLEX_MUTATION_SET_ROOT:
+			node->root = 1;
+			node->width = mutation->width;
+			node->widthMode = mutation->widthMode;
+			node->height = mutation->height;
+			node->heightMode = mutation->heightMode;
+			break;
+		default:
+			break;
+	}
+}
+
+/** Copies the layout of the tree into the results being written. */
+static void publish(struct FlexPipeline *pipeline) {
+	struct FlexPipelineResults *results = pipeline->results + pipeline->back;
+	int nodeCount = pipeline->nodeCapacity;
+	if (nodeCount > results->capacity) {
+		float *values = realloc(results->x, 4 * nodeCount * sizeof *values);
+		if (values) {
+			results->x = values;
+			results->capacity = nodeCount;
+		} else {
+			nodeCount = results->capacity;
+			pipeline->failed = 1;
+		}
+		results->y = results->x + results->capacity;
+		results->width = results->y + results->capacity;
+		results->height = results->width + results->capacity;
+	}
+	for (int i = 0; i < nodeCount; ++i) {
+		const struct FlexNode *node = pipeline->nodes[i] ? &pipeline->nodes[i]->node : NULL;
+		results->x[i] = node ? node->x : 0;
+		results->y[i] = node ? node->y : 0;
+		results->width[i] = node ? node->width : 0;
+		results->height[i] = node ? node->height : 0;
+	}
+	results->nodeCount = nodeCount;
+	results->frame = pipeline->frame;
+	results->failed = pipeline->failed;
+	pipeline->failed = 0;
+	pipeline->back = exchange(&pipeline->ready, pipeline->back | FRESH) & ~FRESH;
+}
+
+int flexPipelineStep(struct FlexPipeline *pipeline) {
+	struct FlexMutationQueue *applying = &pipeline->applying;
+	lockPending(pipeline);
+	long frame = pipeline->pendingFrame;
+	swapQueues(applying, &pipeline->pending);
+	unlockPending(pipeline);
+	if (frame == pipeline->frame) return 0;
+
+	for (int i = 0; i < applying->count; ++i) apply(pipeline, applying->mutations + i);
+	applying->count = 0;
+	for (int i = 0; i < pipeline->nodeCapacity; ++i) {
+		struct FlexPipelineNode *node = pipeline->nodes[i];
+		if (node && node->root && !node->node.parent) {
+			flexNodeLayout(&pipeline->context, &node->node, node->width, node->widthMode, node->height, node->heightMode);
+			node->node.x = node->node.y = 0;
+		}
+	}
+	pipeline->frame = frame;
+	publish(pipeline);
+	return 1;
+}
+
+const struct FlexPipelineResults *flexPipelineAcquire(struct FlexPipeline *pipeline) {
+	if (compareExchange(&pipeline->ready, 0, 0) & FRESH) pipeline->front = exchange(&pipeline->ready, pipeline->front) & ~FRESH;
+	return pipeline->results + pipeline->front;
+}
@@ -0,0 +1,225 @@
+/**
+ * Layout on a dedicated thread, one frame behind the UI thread.
+ *
+ * The UI thread describes its tree as mutations of nodes identified by
+ * integers of its choosing, pushes them with #flexPipelinePush and hands
+ * each frame over with #flexPipelineSubmit. A layout thread owned by the
+ * application repeatedly calls #flexPipelineStep, which applies the
+ * mutations to a #FlexNode copy of the tree, lays out its roots and
+ * publishes the results. The UI thread reads the latest published results
+ * with #flexPipelineAcquire, typically those of the previous frame.
+ *
+ * Leaves size to a content size supplied by the UI thread, so the layout
+ * thread never calls back into the application. The results are triple
+ * buffered: neither thread waits for the other, except to briefly hand
+ * over the mutations.
+ * @file
+ */
+#ifndef FLEX_PIPELINE_H
+#define FLEX_PIPELINE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "flexNode.h"
+
+/** Types of #FlexMutation. */
+enum FlexMutationType {
+	/** Creates FlexMutation#node as a container without children. */
+	FLEX_MUTATION_CREATE,
+	/** Destroys FlexMutation#node, detaching it from its parent and children. */
+	FLEX_MUTATION_DESTROY,
+	/** Inserts the root FlexMutation#child into FlexMutation#node at FlexMutation#index. */
+	FLEX_MUTATION_INSERT_CHILD,
+	/** Removes FlexMutation#child from FlexMutation#node. */
+	FLEX_MUTATION_REMOVE_CHILD,
+	/** Sets the layout parameters of FlexMutation#node to FlexMutation#params. */
+	FLEX_MUTATION_SET_PARAMS,
+	/** Sets the direction and justify of the container FlexMutation#node. */
+	FLEX_MUTATION_SET_CONTAINER,
+	/**
+	 * Makes FlexMutation#node a leaf with the content size FlexMutation#width by FlexMutation#height.
+	 *
+	 * The leaf takes the available size if exact, its content size clamped
+	 * to the available size if at most, and its content size otherwise.
+	 */
+	FLEX_MUTATION_SET_CONTENT,
+	/** Lays out the root FlexMutation#node in every frame with the constraints of the mutation. */
+	FLEX_MUTATION_SET_ROOT
+};
+
+/** A change to the tree of a #FlexPipeline. */
+struct FlexMutation {
+	/** The type of change. */
+	enum FlexMutationType type;
+	/** The node to change, a nonnegative integer. */
+	int node;
+	/** The child to insert or remove. */
+	int child;
+	/** The index to insert the child at, clamped to the child count. */
+	int index;
+	/** The layout parameters. */
+	struct FlexParams params;
+	/** The direction the children are placed in. */
+	enum FlexDirection direction;
+	/** The alignment of the children in the main axis. */
+	enum Align justify;
+	/** The content width, or the available width of a root. */
+	float width;
+	/** The width requirement of a root. */
+	enum MeasureMode widthMode;
+	/** The content height, or the available height of a root. */
+	float height;
+	/** The height requirement of a root. */
+	enum MeasureMode heightMode;
+};
+
+/** A list of mutations. */
+struct FlexMutationQueue {
+	/** The mutations, of which #count are in use. */
+	struct FlexMutation *mutations;
+	/** The number of mutations. */
+	int count;
+	/** The number of mutations allocated. */
+	int capacity;
+};
+
+/** The layout of the tree after a frame. */
+struct FlexPipelineResults {
+	/** The computed coordinates relative to the parent, by node; \c 0 for absent nodes. */
+	float *x, *y;
+	/** The computed sizes, by node; \c 0 for absent nodes. */
+	float *width, *height;
+	/** The number of nodes in the arrays, one more than the greatest node ever created. */
+	int nodeCount;
+	/** The number of nodes allocated. */
+	int capacity;
+	/** The number of submitted frames that have been laid out. */
+	long frame;
+	/** Whether a mutation was dropped for lack of memory. */
+	int failed;
+};
+
+/** A node of the tree of a #FlexPipeline. */
+struct FlexPipelineNode {
+	/** The node; first, so that it points to this. */
+	struct FlexNode node;
+	/** The content size of a leaf. */
+	float contentWidth, contentHeight;
+	/** Whether the node is laid out as a root. */
+	int root;
+	/** The constraints of a root. */
+	float width, height;
+	/** The requirements of a root. */
+	enum MeasureMode widthMode, heightMode;
+};
+
+/** A tree laid out on a dedicated thread. */
+struct FlexPipeline {
+	/**
+	 * The context used by the layout thread.
+	 *
+	 * Defaults to #flexNodeContext with #FLEX_OPTION_CACHE. May be changed
+	 * before the first #flexPipelineStep, e.g. to add a scratch buffer.
+	 */
+	struct FlexContext context;
+	/**
+	 * Wakes the layout thread after #flexPipelineSubmit, or \c NULL.
+	 *
+	 * @param userData #userData.
+	 */
+	void (*wake)(void *userData);
+	/** Pointer passed to #wake. */
+	void *userData;
+
+	/** The mutations of the current frame; owned by the UI thread. */
+	struct FlexMutationQueue queue;
+	/** The number of frames submitted; owned by the UI thread. */
+	long submitted;
+	/** The results read by the UI thread. */
+	int front;
+
+	/** The lock of #pending and #pendingFrame, \c 1 if held. */
+	volatile long lock;
+	/** The mutations submitted but not yet taken by the layout thread. */
+	struct FlexMutationQueue pending;
+	/** The number of frames whose mutations were handed over. */
+	long pendingFrame;
+	/** The index of the latest published results, ORed with \c 4 until acquired. */
+	volatile long ready;
+	/** The triple-buffered results. */
+	struct FlexPipelineResults results[3];
+
+	/** The mutations being applied; owned by the layout thread. */
+	struct FlexMutationQueue applying;
+	/** The nodes by identifier, or \c NULL; owned by the layout thread. */
+	struct FlexPipelineNode **nodes;
+	/** The number of identifiers allocated. */
+	int nodeCapacity;
+	/** The number of frames laid out. */
+	long frame;
+	/** Whether a mutation was dropped since the last publication. */
+	int failed;
+	/** The results written by the layout thread. */
+	int back;
+};
+
+/**
+ * Initializes the specified pipeline with an empty tree.
+ *
+ * @param pipeline The pipeline.
+ */
+void flexPipelineInit(struct FlexPipeline *pipeline);
+
+/**
+ * Frees the tree, the queues and the results of the specified pipeline.
+ *
+ * The layout thread must have stopped calling #flexPipelineStep.
+ *
+ * @param pipeline The pipeline.
+ */
+void flexPipelineDestroy(struct FlexPipeline *pipeline);
+
+/**
+ * Queues a mutation of the tree in the current frame; called by the UI thread.
+ *
+ * Mutations apply in order. Those of nodes that do not exist, and insertions
+ * of nodes that already have a parent or would contain themselves, are
+ * ignored.
+ *
+ * @param pipeline The pipeline.
+ * @param mutation The mutation.
+ * @return Whether the mutation was queued; \c 0 if out of memory.
+ */
+int flexPipelinePush(struct FlexPipeline *pipeline, const struct FlexMutation *mutation);
+
+/**
+ * Hands the mutations of the current frame over to the layout thread; called by the UI thread.
+ *
+ * @param pipeline The pipeline.
+ * @return Whether the frame was handed over; \c 0 if out of memory, in which case its mutations stay queued.
+ */
+int flexPipelineSubmit(struct FlexPipeline *pipeline);
+
+/**
+ * Applies the submitted frames, lays out the roots and publishes the results; called by the layout thread.
+ *
+ * @param pipeline The pipeline.
+ * @return Whether a frame was laid out; \c 0 if none was submitted since the last step.
+ */
+int flexPipelineStep(struct FlexPipeline *pipeline);
+
+/**
+ * Returns the latest published results; called by the UI thread.
+ *
+ * @param pipeline The pipeline.
+ * @return The results, valid until the next call.
+ */
+const struct FlexPipelineResults *flexPipelineAcquire(struct FlexPipeline *pipeline);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,117 @@
+#include "flexTable.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+/** The alignment of the values. */
+#define ALIGNMENT 16
+
+/** The header of a slot, followed by the value. */
+struct Slot {
+	const void *key;
+	unsigned generation;
+};
+
+#define HEADER_SIZE ((sizeof(struct Slot) + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT)
+
+static struct Slot *getSlot(const struct FlexTable *table, size_t index) {
+	return (struct Slot *) (table->slots + index * table->slotSize);
+}
+
+static void *getValue(struct Slot *slot) {
+	return (unsigned char *) slot + HEADER_SIZE;
+}
+
+static int isLive(const struct FlexTable *table, const struct Slot *slot) {
+	return slot->key && slot->generation == table->generation;
+}
+
+/** Returns the home slot of the key, spreading the aligned pointers with Fibonacci hashing. */
+static size_t getHome(const struct FlexTable *table, const void *key) {
+	return (size_t) ((uint64_t) (uintptr_t) key * 0x9E3779B97F4A7C15ULL >> 32) & (table->capacity - 1);
+}
+
+void flexTableInit(struct FlexTable *table, size_t valueSize) {
+	table->slots = NULL;
+	table->valueSize = valueSize;
+	table->slotSize = HEADER_SIZE + (valueSize + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+	table->capacity = table->count = 0;
+	table->generation = 1;
+}
+
+void flexTableDestroy(struct FlexTable *table) {
+	free(table->slots);
+	flexTableInit(table, table->valueSize);
+}
+
+/** Returns the slot holding the key, or the empty slot where it would be inserted. */
+static struct Slot *probe(const struct FlexTable *table, const void *key) {
+	for (size_t i = getHome(table, key);; i = (i + 1) & (table->capacity - 1)) {
+		struct Slot *slot = getSlot(table, i);
+		if (!isLive(table, slot) || slot->key == key) return slot;
+	}
+}
+
+static int grow(struct FlexTable *table) {
+	struct FlexTable old = *table;
+	table->capacity = old.capacity ? 2 * old.capacity : 16;
+	if (!(table->slots = calloc(table->capacity, table->slotSize))) {
+		*table = old;
+		return 0;
+	}
+	for (size_t i = 0; i < old.capacity; ++i) {
+		struct Slot *slot = getSlot(&old, i);
+		if (!isLive(&old, slot)) continue;
+		memcpy(probe(table, slot->key), slot, table->slotSize);
+	}
+	free(old.slots);
+	return 1;
+}
+
+void *flexTableGet(struct FlexTable *table, const void *widget) {
+	struct Slot *slot = table->capacity ? probe(table, widget) : NULL;
+	if (slot && isLive(table, slot)) return getValue(slot);
+	// Only grow when inserting, so that lookups of present widgets leave the table as it is
+	if (4 * (table->count + 1) > 3 * table->capacity) {
+		if (!grow(table)) return NULL;
+		slot = probe(table, widget);
+	}
+	slot->key = widget;
+	slot->generation = table->generation;
+	memset(getValue(slot), 0, table->valueSize);
+	++table->count;
+	return getValue(slot);
+}
+
+void *flexTableFind(const struct FlexTable *table, const void *widget) {
+	if (!table->capacity) return NULL;
+	struct Slot *slot = probe(table, widget);
+	return isLive(table, slot) ? getValue(slot) : NULL;
+}
+
+void flexTableRemove(struct FlexTable *table, const void *widget) {
+	if (!table->capacity) return;
+	struct Slot *hole = probe(table, widget);
+	if (!isLive(table, hole)) return;
+	--table->count;
+
+	// Shift back the following entries of the cluster that may not stay past the hole
+	size_t mask = table->capacity - 1, i = (size_t) ((unsigned char *) hole - table->slots) / table->slotSize;
+	for (size_t j = (i + 1) & mask;; j = (j + 1) & mask) {
+		struct Slot *slot = getSlot(table, j);
+		if (!isLive(table, slot)) break;
+		size_t home = getHome(table, slot->key);
+		if (((j - home) & mask) < ((j - i) & mask)) continue;
+		memcpy(getSlot(table, i), slot, table->slotSize);
+		i = j;
+	}
+	getSlot(table, i)->key = NULL;
+}
+
+void flexTableClear(struct FlexTable *table) {
+	table->count = 0;
+	if (++table->generation) return;
+	// Make sure no slot matches the next generations after wrapping around
+	if (table->slots) memset(table->slots, 0, table->capacity * table->slotSize);
+	table->generation = 1;
+}
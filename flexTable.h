@@ -0,0 +1,92 @@
+/**
+ * A hash table keyed by widget pointer.
+ *
+ * Lets the library keep state such as the #FlexState of widgets that have no
+ * room for it, see FlexContext#stateTable. The table uses open addressing
+ * with linear probing and stores the values inline. Every entry is tagged
+ * with the generation of the table, so that clearing it only advances the
+ * generation. Applications may use tables of their own for other per-widget
+ * data.
+ * @file
+ */
+#ifndef FLEX_TABLE_H
+#define FLEX_TABLE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+
+/** A hash table mapping widgets to values of a fixed size. */
+struct FlexTable {
+	/** The slots, each holding a key, a generation and a value. */
+	unsigned char *slots;
+	/** The size of a value in bytes. */
+	size_t valueSize;
+	/** The size of a slot in bytes. */
+	size_t slotSize;
+	/** The number of slots, a power of two or \c 0. */
+	size_t capacity;
+	/** The number of entries. */
+	size_t count;
+	/** The generation of the entries in the table; slots of other generations are empty. */
+	unsigned generation;
+};
+
+/**
+ * Initializes the specified table as empty.
+ *
+ * @param table The table.
+ * @param valueSize The size of the values in bytes.
+ */
+void flexTableInit(struct FlexTable *table, size_t valueSize);
+
+/**
+ * Frees the storage of the specified table.
+ *
+ * @param table The table.
+ */
+void flexTableDestroy(struct FlexTable *table);
+
+/**
+ * Returns the value of the specified widget, inserting it zero-filled if absent.
+ *
+ * Inserting may move the other values. Looking up widgets already in the
+ * table does not modify it, and may therefore happen concurrently.
+ *
+ * @param table The table.
+ * @param widget The widget, not \c NULL.
+ * @return The value, or \c NULL if out of memory.
+ */
+void *flexTableGet(struct FlexTable *table, const void *widget);
+
+/**
+ * Returns the value of the specified widget.
+ *
+ * @param table The table.
+ * @param widget The widget.
+ * @return The value, or \c NULL if absent.
+ */
+void *flexTableFind(const struct FlexTable *table, const void *widget);
+
+/**
+ * Removes the specified widget, e.g. as it is destroyed.
+ *
+ * @param table The table.
+ * @param widget The widget.
+ */
+void flexTableRemove(struct FlexTable *table, const void *widget);
+
+/**
+ * Removes all entries in constant time.
+ *
+ * @param table The table.
+ */
+void flexTableClear(struct FlexTable *table);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
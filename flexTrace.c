@@ -0,0 +1,556 @@
+#include "flexTrace.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+/** The kinds of records in a trace, each followed by the widget and the arguments. */
+enum Event {
+	EVENT_LAYOUT_FLEX = 1,
+	EVENT_LAYOUT,
+	/** Written after FlexContext#layout returns with the resulting size. */
+	EVENT_LAYOUT_END,
+	EVENT_CHILD_COUNT,
+	EVENT_CHILD_AT,
+	EVENT_LAYOUT_PARAMS,
+	EVENT_GET_WIDTH,
+	EVENT_GET_HEIGHT,
+	EVENT_SET_X,
+	EVENT_SET_Y,
+	EVENT_SET_WIDTH,
+	EVENT_SET_HEIGHT
+};
+
+static const char magic[4] = { 'F', 'L', 'X', 'T' };
+#define TRACE_VERSION 1
+
+/** The active recording. */
+static struct Recorder {
+	const struct FlexContext *inner;
+	FILE *file;
+	int error;
+	/** Open addressing table mapping widgets to their ids. */
+	const void **widgets;
+	int *ids;
+	int capacity, count;
+} recorder;
+
+static unsigned hashWidget(const void *widget) {
+	uintptr_t value = (uintptr_t) widget;
+	return (unsigned) ((value >> 4) ^ (value >> 20)) * 2654435761u;
+}
+
+/** Returns the id of the widget, assigning the next one if it is new. */
+static int getId(const void *widget) {
+	if (2 * (recorder.count + 1) > recorder.capacity) {
+		int capacity = recorder.capacity ? 2 * recorder.capacity : 256;
+		const void **widgets = calloc(capacity, sizeof *widgets);
+		int *ids = malloc(capacity * sizeof *ids);
+		if (!widgets || !ids) {
+			free(widgets);
+			free(ids);
+			recorder.error = 1;
+			return 0;
+		}
+		for (int i = 0; i < recorder.capacity; ++i) {
+			if (!recorder.widgets[i]) continue;
+			unsigned j = hashWidget(recorder.widgets[i]) & (capacity - 1);
+			while (widgets[j]) j = (j + 1) & (capacity - 1);
+			widgets[j] = recorder.widgets[i];
+			ids[j] = recorder.ids[i];
+		}
+		free(recorder.widgets);
+		free(recorder.ids);
+		recorder.widgets = widgets;
+		recorder.ids = ids;
+		recorder.capacity = capacity;
+	}
+	unsigned i = hashWidget(widget) & (recorder.capacity - 1);
+	for (; recorder.widgets[i]; i = (i + 1) & (recorder.capacity - 1)) {
+		if (recorder.widgets[i] == widget) return recorder.ids[i];
+	}
+	recorder.widgets[i] = widget;
+	return recorder.ids[i] = recorder.count++;
+}
+
+static void writeByte(int byte) {
+	if (putc(byte, recorder.file) == EOF) recorder.error = 1;
+}
+
+static void writeVarint(unsigned value) {
+	for (; value >= 0x80; value >>= 7) writeByte((value & 0x7F) | 0x80);
+	writeByte(value);
+}
+
+static void writeFloat(float value) {
+	if (fwrite(&value, sizeof value, 1, recorder.file) != 1) recorder.error = 1;
+}
+
+static void writeEvent(enum Event event, const void *widget) {
+	writeByte(event);
+	writeVarint(getId(widget));
+}
+
+static void recordSetX(const void *widget, float x) {
+	writeEvent(EVENT_SET_X, widget);
+	writeFloat(x);
+	recorder.inner->setX(widget, x);
+}
+
+static void recordSetY(const void *widget, float y) {
+	writeEvent(EVENT_SET_Y, widget);
+	writeFloat(y);
+	recorder.inner->setY(widget, y);
+}
+
+static float recordGetWidth(const void *widget) {
+	float width = recorder.inner->getWidth(widget);
+	writeEvent(EVENT_GET_WIDTH, widget);
+	writeFloat(width);
+	return width;
+}
+
+static void recordSetWidth(const void *widget, float width) {
+	writeEvent(EVENT_SET_WIDTH, widget);
+	writeFloat(width);
+	recorder.inner->setWidth(widget, width);
+}
+
+static float recordGetHeight(const void *widget) {
+	float height = recorder.inner->getHeight(widget);
+	writeEvent(EVENT_GET_HEIGHT, widget);
+	writeFloat(height);
+	return height;
+}
+
+static void recordSetHeight(const void *widget, float height) {
+	writeEvent(EVENT_SET_HEIGHT, widget);
+	writeFloat(height);
+	recorder.inner->setHeight(widget, height);
+}
+
+static void recordLayout(const void *widget, float width, enum MeasureMode widthMode, float height, enum MeasureMode heightMode) {
+	writeEvent(EVENT_LAYOUT, widget);
+	writeFloat(width);
+	writeByte(widthMode);
+	writeFloat(height);
+	writeByte(heightMode);
+	recorder.inner->layout(widget, width, widthMode, height, heightMode);
+	writeEvent(EVENT_LAYOUT_END, widget);
+	writeFloat(recorder.inner->getWidth(widget));
+	writeFloat(recorder.inner->getHeight(widget));
+}
+
+static int recordGetChildCount(const void *widget) {
+	int count = recorder.inner->getChildCount(widget);
+	writeEvent(EVENT_CHILD_COUNT, widget);
+	writeVarint(count);
+	return count;
+}
+
+static void *recordGetChildAt(const void *widget, int index) {
+	void *child = recorder.inner->getChildAt(widget, index);
+	writeEvent(EVENT_CHILD_AT, widget);
+	writeVarint(index);
+	writeVarint(getId(child));
+	return child;
+}
+
+static void *recordGetLayoutParams(const void *widget) {
+	struct FlexParams *params = recorder.inner->getLayoutParams(widget);
+	writeEvent(EVENT_LAYOUT_PARAMS, widget);
+	writeByte(params->align);
+	writeFloat(params->flex);
+	writeFloat(params->width);
+	writeFloat(params->height);
+	writeFloat(params->marginTop);
+	writeFloat(params->marginRight);
+	writeFloat(params->marginBottom);
+	writeFloat(params->marginLeft);
+	return params;
+}
+
+static void recordLayoutFlex(const void *widget, float width, enum MeasureMode widthMode, float height, enum MeasureMode heightMode, enum FlexDirection direction, enum Align justify) {
+	writeEvent(EVENT_LAYOUT_FLEX, widget);
+	writeFloat(width);
+	writeByte(widthMode);
+	writeFloat(height);
+	writeByte(heightMode);
+	writeByte(direction);
+	writeByte(justify);
+	if (recorder.inner->onLayoutFlex) recorder.inner->onLayoutFlex(widget, width, widthMode, height, heightMode, direction, justify);
+}
+
+int flexTraceBegin(struct FlexContext *context, const struct FlexContext *inner, FILE *file) {
+	if (recorder.file) return 0;
+	recorder.inner = inner;
+	recorder.file = file;
+	recorder.error = 0;
+	*context = *inner;
+	context->setX = recordSetX;
+	context->setY = recordSetY;
+	context->getWidth = recordGetWidth;
+	context->setWidth = recordSetWidth;
+	context->getHeight = recordGetHeight;
+	context->setHeight = recordSetHeight;
+	context->layout = recordLayout;
+	context->getChildCount = recordGetChildCount;
+	context->getChildAt = recordGetChildAt;
+	context->getLayoutParams = recordGetLayoutParams;
+	context->scheduler = NULL;
+	context->onLayoutFlex = recordLayoutFlex;
+
+	if (fwrite(magic, sizeof magic, 1, file) != 1) recorder.error = 1;
+	writeByte(TRACE_VERSION);
+	return 1;
+}
+
+int flexTraceEnd(void) {
+	int success = !recorder.error && !fflush(recorder.file);
+	free(recorder.widgets);
+	free(recorder.ids);
+	memset(&recorder, 0, sizeof recorder);
+	return success;
+}
+
+/** A position in a trace being read. */
+struct Reader {
+	const unsigned char *data, *end;
+	int error;
+};
+
+static int readByte(struct Reader *reader) {
+	if (reader->data == reader->end) {
+		reader->error = 1;
+		return 0;
+	}
+	return *reader->data++;
+}
+
+static unsigned readVarint(struct Reader *reader) {
+	unsigned value = 0;
+	for (int shift = 0; shift < 32; shift += 7) {
+		int byte = readByte(reader);
+		value |= (unsigned) (byte & 0x7F) << shift;
+		if (!(byte & 0x80)) return value;
+	}
+	reader->error = 1;
+	return 0;
+}
+
+static float readFloat(struct Reader *reader) {
+	float value = 0;
+	if (reader->end - reader->data < (long) sizeof value) {
+		reader->error = 1;
+		return 0;
+	}
+	memcpy(&value, reader->data, sizeof value);
+	reader->data += sizeof value;
+	return value;
+}
+
+/** What is known about a widget while reading a trace. */
+struct WidgetInfo {
+	int isContainer;
+	enum FlexDirection direction;
+	enum Align justify;
+	struct FlexParams params;
+	int *children;
+	int childCount;
+	int sampleCount;
+};
+
+/** A measurement waiting for its result. */
+struct PendingLayout {
+	int id;
+	struct FlexTraceSample sample;
+};
+
+/** The state of a trace being loaded. */
+struct Loader {
+	struct WidgetInfo *infos;
+	int infoCount, infoCapacity;
+	struct PendingLayout *pending;
+	int pendingCount, pendingCapacity;
+	struct FlexTraceSample *samples;
+	int *sampleIds;
+	int sampleCount, sampleCapacity;
+	/** The largest valid id, as each widget is named by an event. */
+	size_t maxId;
+};
+
+static int sameConstraint(float a, enum MeasureMode aMode, float b, enum MeasureMode bMode) {
+	return aMode == bMode && (aMode == MEASURE_UNSPECIFIED || a == b || (isUndefined(a) && isUndefined(b)));
+}
+
+static void measureLeaf(struct FlexNode *node, float width, enum MeasureMode widthMode, float height, enum MeasureMode heightMode) {
+	const struct FlexTraceLeaf *leaf = node->userData;
+	const struct FlexTraceSample *samples = leaf->samples;
+	for (int i = 0; i < leaf->sampleCount; ++i) {
+		if (sameConstraint(samples[i].width, samples[i].widthMode, width, widthMode)
+				&& sameConstraint(samples[i].height, samples[i].heightMode, height, heightMode)) {
+			node->width = samples[i].resultWidth;
+			node->height = samples[i].resultHeight;
+			return;
+		}
+	}
+	// Otherwise fit the last recorded size into the constraints
+	float resultWidth = leaf->sampleCount ? samples[leaf->sampleCount - 1].resultWidth : 0,
+		  resultHeight = leaf->sampleCount ? samples[leaf->sampleCount - 1].resultHeight : 0;
+	node->width = widthMode == MEASURE_EXACTLY || (widthMode == MEASURE_AT_MOST && resultWidth > width) ? width : resultWidth;
+	node->height = heightMode == MEASURE_EXACTLY || (heightMode == MEASURE_AT_MOST && resultHeight > height) ? height : resultHeight;
+}
+
+/** Reads the whole file into memory. */
+static unsigned char *readFile(FILE *file, size_t *size) {
+	unsigned char *data = NULL;
+	size_t capacity = 0;
+	*size = 0;
+	for (;;) {
+		if (*size == capacity) {
+			capacity = capacity ? 2 * capacity : 1 << 16;
+			unsigned char *newData = realloc(data, capacity);
+			if (!newData) {
+				free(data);
+				return NULL;
+			}
+			data = newData;
+		}
+		size_t count = fread(data + *size, 1, capacity - *size, file);
+		if (!count) break;
+		*size += count;
+	}
+	if (ferror(file)) {
+		free(data);
+		return NULL;
+	}
+	return data;
+}
+
+static struct WidgetInfo *getInfo(struct Loader *loader, int id) {
+	if (id >= loader->infoCount) {
+		if (id >= loader->infoCapacity) {
+			int capacity = 2 * id + 16;
+			struct WidgetInfo *infos = realloc(loader->infos, capacity * sizeof *infos);
+			if (!infos) return NULL;
+			loader->infos = infos;
+			loader->infoCapacity = capacity;
+		}
+		memset(loader->infos + loader->infoCount, 0, (id + 1 - loader->infoCount) * sizeof *loader->infos);
+		loader->infoCount = id + 1;
+	}
+	return loader->infos + id;
+}
+
+static struct PendingLayout *pushPending(struct Loader *loader) {
+	if (loader->pendingCount == loader->pendingCapacity) {
+		int capacity = loader->pendingCapacity ? 2 * loader->pendingCapacity : 64;
+		struct PendingLayout *pending = realloc(loader->pending, capacity * sizeof *pending);
+		if (!pending) return NULL;
+		loader->pending = pending;
+		loader->pendingCapacity = capacity;
+	}
+	return loader->pending + loader->pendingCount++;
+}
+
+static struct FlexTraceSample *pushSample(struct Loader *loader, int id) {
+	if (loader->sampleCount == loader->sampleCapacity) {
+		int capacity = loader->sampleCapacity ? 2 * loader->sampleCapacity : 256;
+		struct FlexTraceSample *samples = realloc(loader->samples, capacity * sizeof *samples);
+		if (!samples) return NULL;
+		loader->samples = samples;
+		int *sampleIds = realloc(loader->sampleIds, capacity * sizeof *sampleIds);
+		if (!sampleIds) return NULL;
+		loader->sampleIds = sampleIds;
+		loader->sampleCapacity = capacity;
+	}
+	loader->sampleIds[loader->sampleCount] = id;
+	return loader->samples + loader->sampleCount++;
+}
+
+/**
+ * Collects what is known about each widget from the events of a trace.
+ *
+ * @return The id of the root, or \c -1 if the trace is malformed or out of memory.
+ */
+static int readEvents(struct Loader *loader, struct Reader *reader, struct FlexTrace *trace) {
+	int root = -1;
+	while (reader->data != reader->end) {
+		enum Event event = readByte(reader);
+		int id = readVarint(reader);
+		struct WidgetInfo *info;
+		if (reader->error || id < 0 || (size_t) id > loader->maxId || !(info = getInfo(loader, id))) return -1;
+
+		switch (event) {
+			case EVENT_LAYOUT_FLEX:
+			case EVENT_LAYOUT: {
+				struct PendingLayout *layout = event == EVENT_LAYOUT ? pushPending(loader) : NULL;
+				float width = readFloat(reader);
+				enum MeasureMode widthMode = readByte(reader);
+				float height = readFloat(reader);
+				enum MeasureMode heightMode = readByte(reader);
+				if (root < 0) {
+					root = id;
+					trace->width = width;
+					trace->widthMode = widthMode;
+					trace->height = height;
+					trace->heightMode = heightMode;
+				}
+				if (event == EVENT_LAYOUT_FLEX) {
+					info->isContainer = 1;
+					info->direction = readByte(reader);
+					info->justify = readByte(reader);
+				} else if (layout) {
+					layout->id = id;
+					layout->sample.width = width;
+					layout->sample.widthMode = widthMode;
+					layout->sample.height = height;
+					layout->sample.heightMode = heightMode;
+				} else return -1;
+				break;
+			}
+			case EVENT_LAYOUT_END: {
+				if (!loader->pendingCount || loader->pending[loader->pendingCount - 1].id != id) return -1;
+				struct FlexTraceSample *sample = pushSample(loader, id);
+				if (!sample) return -1;
+				*sample = loader->pending[--loader->pendingCount].sample;
+				sample->resultWidth = readFloat(reader);
+				sample->resultHeight = readFloat(reader);
+				++info->sampleCount;
+				break;
+			}
+			case EVENT_CHILD_COUNT: {
+				int count = readVarint(reader);
+				if (count != info->childCount) {
+					int *children = realloc(info->children, count * sizeof *children);
+					if (count && !children) return -1;
+					for (int i = info->childCount; i < count; ++i) children[i] = -1;
+					info->children = children;
+					info->childCount = count;
+				}
+				break;
+			}
+			case EVENT_CHILD_AT: {
+				int index = readVarint(reader), child = readVarint(reader);
+				if (child < 0 || (size_t) child > loader->maxId || !getInfo(loader, child)) return -1;
+				info = loader->infos + id;
+				if (index >= 0 && index < info->childCount) info->children[index] = child;
+				break;
+			}
+			case EVENT_LAYOUT_PARAMS:
+				info->params.align = readByte(reader);
+				info->params.flex = readFloat(reader);
+				info->params.width = readFloat(reader);
+				info->params.height = readFloat(reader);
+				info->params.marginTop = readFloat(reader);
+				info->params.marginRight = readFloat(reader);
+				info->params.marginBottom = readFloat(reader);
+				info->params.marginLeft = readFloat(reader);
+				break;
+			case EVENT_GET_WIDTH:
+			case EVENT_GET_HEIGHT:
+			case EVENT_SET_X:
+			case EVENT_SET_Y:
+			case EVENT_SET_WIDTH:
+			case EVENT_SET_HEIGHT:
+				readFloat(reader);
+				break;
+			default:
+				return -1;
+		}
+		if (reader->error) return -1;
+	}
+	return root;
+}
+
+/** Returns whether the node is the other node or one of its ancestors. */
+static int isAncestor(const struct FlexNode *node, const struct FlexNode *descendant) {
+	for (; descendant; descendant = descendant->parent) {
+		if (descendant == node) return 1;
+	}
+	return 0;
+}
+
+/** Creates the nodes of the trace from the collected information, ignoring edges that would form cycles. */
+static int buildTree(struct FlexTrace *trace, struct Loader *loader) {
+	int nodeCount = loader->infoCount;
+	trace->nodes = malloc(nodeCount * sizeof *trace->nodes);
+	trace->leaves = malloc(nodeCount * sizeof *trace->leaves);
+	trace->samples = malloc(loader->sampleCount * sizeof *trace->samples);
+	if (!trace->nodes || !trace->leaves || (loader->sampleCount && !trace->samples)) return 0;
+	trace->nodeCount = nodeCount;
+
+	// Group the samples by node, keeping their order
+	struct FlexTraceSample *samples = trace->samples;
+	for (int i = 0; i < nodeCount; ++i) {
+		trace->leaves[i].samples = samples;
+		trace->leaves[i].sampleCount = 0;
+		samples += loader->infos[i].sampleCount;
+	}
+	for (int i = 0; i < loader->sampleCount; ++i) {
+		struct FlexTraceLeaf *leaf = trace->leaves + loader->sampleIds[i];
+		leaf->samples[leaf->sampleCount++] = loader->samples[i];
+	}
+
+	for (int i = 0; i < nodeCount; ++i) {
+		struct FlexNode *node = trace->nodes + i;
+		struct WidgetInfo *info = loader->infos + i;
+		flexNodeInit(node);
+		node->params = info->params;
+		if (info->isContainer) {
+			node->direction = info->direction;
+			node->justify = info->justify;
+		} else {
+			node->measure = measureLeaf;
+			node->userData = trace->leaves + i;
+		}
+	}
+	for (int i = 0; i < nodeCount; ++i) {
+		struct WidgetInfo *info = loader->infos + i;
+		for (int j = 0; j < info->childCount; ++j) {
+			int child = info->children[j];
+			if (child < 0 || child >= nodeCount || trace->nodes[child].parent || isAncestor(trace->nodes + child, trace->nodes + i)) continue;
+			if (!flexNodeInsertChild(trace->nodes + i, trace->nodes + child, trace->nodes[i].childCount)) return 0;
+		}
+	}
+	return 1;
+}
+
+int flexTraceLoad(struct FlexTrace *trace, FILE *file) {
+	size_t size;
+	unsigned char *data = readFile(file, &size);
+	memset(trace, 0, sizeof *trace);
+	if (!data) return 0;
+
+	struct Reader reader = { data, data + size, 0 };
+	struct Loader loader;
+	memset(&loader, 0, sizeof loader);
+	loader.maxId = size;
+	int root = -1;
+	if (size > sizeof magic && !memcmp(data, magic, sizeof magic) && data[sizeof magic] == TRACE_VERSION) {
+		reader.data += sizeof magic + 1;
+		root = readEvents(&loader, &reader, trace);
+	}
+	int success = root >= 0 && buildTree(trace, &loader);
+	if (success) trace->root = trace->nodes + root;
+	else flexTraceDestroy(trace);
+
+	for (int i = 0; i < loader.infoCount; ++i) free(loader.infos[i].children);
+	free(loader.infos);
+	free(loader.pending);
+	free(loader.samples);
+	free(loader.sampleIds);
+	free(data);
+	return success;
+}
+
+void flexTraceDestroy(struct FlexTrace *trace) {
+	if (trace->nodes) {
+		for (int i = 0; i < trace->nodeCount; ++i) {
+			free(trace->nodes[i].children);
+		}
+	}
+	free(trace->nodes);
+	free(trace->leaves);
+	free(trace->samples);
+	memset(trace, 0, sizeof *trace);
+}
@@ -0,0 +1,112 @@
+/**
+ * Recording of the callbacks made during layout and offline replay.
+ *
+ * A trace is a compact binary log, in native byte order, of every callback
+ * the library makes through a recording context. Loading it reconstructs
+ * the tree as #FlexNode objects whose leaves answer measurements from the
+ * recorded results, so that layout can be rerun and profiled without the
+ * application.
+ * @file
+ */
+#ifndef FLEX_TRACE_H
+#define FLEX_TRACE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "flexNode.h"
+#include <stdio.h>
+
+/**
+ * Starts recording the callbacks made through a wrapping context.
+ *
+ * Only one recording may be active at a time, and only the calling thread
+ * may lay out with the recording context. Nested containers must be laid out
+ * with #flexCurrentContext for their callbacks to be recorded.
+ *
+ * @param context Set to the recording context, which forwards to \a inner.
+ * It lays out children serially regardless of FlexContext#scheduler.
+ * @param inner The context to record.
+ * @param file The file to write the trace to.
+ * @return Whether the recording was started.
+ */
+int flexTraceBegin(struct FlexContext *context, const struct FlexContext *inner, FILE *file);
+
+/**
+ * Stops the active recording.
+ *
+ * @return Whether the whole trace was written successfully.
+ */
+int flexTraceEnd(void);
+
+/** A measurement of a leaf recorded in a trace. */
+struct FlexTraceSample {
+	/** The available width. */
+	float width;
+	/** The width requirement. */
+	enum MeasureMode widthMode;
+	/** The available height. */
+	float height;
+	/** The height requirement. */
+	enum MeasureMode heightMode;
+	/** The resulting width. */
+	float resultWidth;
+	/** The resulting height. */
+	float resultHeight;
+};
+
+/** The measurements of a node recorded in a trace. */
+struct FlexTraceLeaf {
+	/** The measurements in the order they were made. */
+	struct FlexTraceSample *samples;
+	/** The number of measurements. */
+	int sampleCount;
+};
+
+/** A tree reconstructed from a trace. */
+struct FlexTrace {
+	/** The root, laid out first in the trace. */
+	struct FlexNode *root;
+	/** The width the root was laid out with. */
+	float width;
+	/** The width requirement of the root. */
+	enum MeasureMode widthMode;
+	/** The height the root was laid out with. */
+	float height;
+	/** The height requirement of the root. */
+	enum MeasureMode heightMode;
+	/** The nodes of the tree. */
+	struct FlexNode *nodes;
+	/** The number of nodes. */
+	int nodeCount;
+	/** The recorded measurements of each node, indexed like #nodes. */
+	struct FlexTraceLeaf *leaves;
+	/** The storage of the measurements, grouped by node. */
+	struct FlexTraceSample *samples;
+};
+
+/**
+ * Reconstructs the tree recorded in the specified trace.
+ *
+ * Leaves are measured with the recorded result of the same constraints, or
+ * otherwise with their last recorded size fitted into the constraints.
+ *
+ * @param trace The trace to initialize.
+ * @param file The file containing the trace.
+ * @return Whether the trace was loaded; \c 0 if malformed or out of memory.
+ */
+int flexTraceLoad(struct FlexTrace *trace, FILE *file);
+
+/**
+ * Frees the tree of the specified trace.
+ *
+ * @param trace The trace.
+ */
+void flexTraceDestroy(struct FlexTrace *trace);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
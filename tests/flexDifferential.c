@@ -0,0 +1,726 @@
+/*
+ * Differential test of the options and engines of the library.
+ *
+ * Usage: flexLayout_differential [--trees N] [--seed N]
+ *
+ * Random trees are laid out with #layoutFlex and no optional members of the
+ * context, and then with each variant, which must compute bitwise the same
+ * positions and sizes. The results are first overwritten with NaN, so that
+ * results a variant fails to set are caught. The content of one leaf of each
+ * tree changes, possibly in one axis only: the variants that cache layouts
+ * first lay out the tree as it was before, so that stale cache entries are
+ * caught as well. Some trees have leaves that keep the area of their content,
+ * becoming taller as they become narrower like wrapped text and shorter as
+ * they are stretched, which the engines with their own leaves skip. A few
+ * fixed trees reproduce past bugs.
+ */
+#include "flexBatch.h"
+#include "flexCache.h"
+#include "flexParams.h"
+#include "flexPipeline.h"
+#include "flexTable.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/** The greatest number of widgets of a tree. */
+#define MAX_NODES 256
+/** The greatest number of children of a container. */
+#define MAX_CHILDREN 4
+/** The number of trees laid out together by the batch variant. */
+#define BATCH_TREE_COUNT 3
+
+static unsigned long long randomState = 88172645463325252ULL;
+
+static unsigned nextRandom(void) {
+	randomState ^= randomState << 13;
+	randomState ^= randomState >> 7;
+	randomState ^= randomState << 17;
+	return (unsigned) (randomState >> 32);
+}
+
+static int randomInt(int n) {
+	return nextRandom() % n;
+}
+
+/** Returns a random content size, sometimes fractional to exercise the truncation of sizes. */
+static float randomContentSize(int n) {
+	return randomInt(n) + (randomInt(4) ? 0 : 0.5f);
+}
+
+/** A widget of an application without a retained tree of the library. */
+struct Widget {
+	struct FlexParams params;
+	/** The parameters to lay out with: #params, or an interned copy. */
+	struct FlexParams *layoutParams;
+	enum FlexDirection direction;
+	enum Align justify;
+	/** Whether the widget is a leaf sized to its content. */
+	int leaf;
+	/** Whether the leaf keeps the area of its content, its height depending on its width. */
+	int wrap;
+	float contentWidth, contentHeight;
+	struct Widget *parent, *children[MAX_CHILDREN];
+	int childCount;
+	float x, y, width, height;
+	struct FlexState state;
+};
+
+/** A random tree whose widgets are in preorder, and a change of the content of one of its leaves. */
+struct Tree {
+	struct Widget widgets[MAX_NODES];
+	int count;
+	float width, height;
+	enum MeasureMode widthMode, heightMode;
+	/** The leaf whose content changed. */
+	struct Widget *changed;
+	/** The content of #changed before the change. */
+	float oldWidth, oldHeight;
+	/** The axes whose content changed, as #FlexStateFlag values. */
+	int changedAxes;
+	/** Whether any leaf wraps. */
+	int wraps;
+};
+
+static struct Widget *addWidget(struct Tree *tree, struct Widget *parent, int depth, int wraps) {
+	static const enum Align aligns[] = { ALIGN_START, ALIGN_END, ALIGN_CENTER, ALIGN_STRETCH };
+	struct Widget *widget = tree->widgets + tree->count++;
+	struct FlexParams *params = &widget->params;
+	memset(widget, 0, sizeof *widget);
+	params->align = randomInt(2) ? ALIGN_STRETCH : aligns[randomInt(4)];
+	params->flex = randomInt(2) ? 0 : (randomInt(3) - 1) * (1 + randomInt(3));
+	params->width = randomInt(4) ? UNDEFINED : randomInt(100);
+	params->height = randomInt(4) ? UNDEFINED : randomInt(100);
+	if (!randomInt(3)) {
+		params->marginTop = randomInt(5);
+		params->marginRight = randomInt(3);
+		params->marginBottom = randomInt(3);
+		params->marginLeft = randomInt(5);
+	}
+	widget->layoutParams = params;
+	widget->direction = randomInt(2) ? DIRECTION_ROW : DIRECTION_COLUMN;
+	widget->justify = randomInt(5); // ALIGN_START to ALIGN_SPACE_AROUND
+	widget->parent = parent;
+	if (parent) parent->children[parent->childCount++] = widget;
+
+	if (parent && (!depth || !randomInt(4))) {
+		widget->leaf = 1;
+		widget->wrap = wraps && randomInt(2);
+		widget->contentWidth = randomContentSize(80);
+		widget->contentHeight = randomContentSize(40);
+		return widget;
+	}
+	for (int i = 0, childCount = 1 + randomInt(MAX_CHILDREN); i < childCount && tree->count < MAX_NODES; ++i) {
+		addWidget(tree, widget, depth - 1, wraps);
+	}
+	return widget;
+}
+
+static void generateTree(struct Tree *tree) {
+	tree->count = 0;
+	tree->wraps = randomInt(2);
+	addWidget(tree, NULL, 3 + randomInt(3), tree->wraps);
+	tree->width = randomInt(300);
+	tree->widthMode = randomInt(3);
+	tree->height = randomInt(300);
+	tree->heightMode = randomInt(3);
+
+	int leafCount = 0;
+	for (int i = 0; i < tree->count; ++i) leafCount += tree->widgets[i].leaf;
+	tree->changed = NULL;
+	for (int i = 0, leaf = leafCount ? randomInt(leafCount) : -1; i < tree->count; ++i) {
+		if (tree->widgets[i].leaf && !leaf--) tree->changed = tree->widgets + i;
+	}
+	if (!tree->changed) return;
+	tree->changedAxes = randomInt(4) ? 1 + randomInt(2) : FLEX_DIRTY;
+	// The height of wrapping content depends on its width
+	if (tree->changed->wrap && tree->changedAxes & FLEX_DIRTY_WIDTH) tree->changedAxes = FLEX_DIRTY;
+	tree->oldWidth = tree->changed->contentWidth;
+	tree->oldHeight = tree->changed->contentHeight;
+	if (tree->changedAxes & FLEX_DIRTY_WIDTH) tree->changed->contentWidth = randomContentSize(80);
+	if (tree->changedAxes & FLEX_DIRTY_HEIGHT) tree->changed->contentHeight = randomContentSize(40);
+}
+
+/** Adds a widget with the default parameters. */
+static struct Widget *addFixedWidget(struct Tree *tree, struct Widget *parent, enum FlexDirection direction, enum Align align) {
+	struct Widget *widget = tree->widgets + tree->count++;
+	memset(widget, 0, sizeof *widget);
+	widget->params.align = align;
+	widget->params.width = widget->params.height = UNDEFINED;
+	widget->layoutParams = &widget->params;
+	widget->direction = direction;
+	widget->justify = ALIGN_START;
+	widget->parent = parent;
+	if (parent) parent->children[parent->childCount++] = widget;
+	return widget;
+}
+
+/**
+ * A column holding a row holding a column of a stretched wrapping leaf and a leaf that becomes wider.
+ *
+ * Only the width of the content changes, yet the stretched leaf becomes
+ * shorter and so do its ancestors: marking them dirty in the width only kept
+ * the stale height of the row.
+ */
+static void buildStretchedWrap(struct Tree *tree) {
+	tree->count = 0;
+	tree->wraps = 1;
+	struct Widget *root = addFixedWidget(tree, NULL, DIRECTION_COLUMN, ALIGN_START),
+		*row = addFixedWidget(tree, root, DIRECTION_ROW, ALIGN_START),
+		*column = addFixedWidget(tree, row, DIRECTION_COLUMN, ALIGN_START),
+		*wrapped = addFixedWidget(tree, column, DIRECTION_ROW, ALIGN_STRETCH),
+		*widened = addFixedWidget(tree, column, DIRECTION_ROW, ALIGN_START);
+	wrapped->leaf = wrapped->wrap = 1;
+	wrapped->contentWidth = 10;
+	wrapped->contentHeight = 100;
+	widened->leaf = 1;
+	widened->contentWidth = 200;
+	widened->contentHeight = 5;
+	tree->width = 400;
+	tree->widthMode = MEASURE_UNSPECIFIED;
+	tree->height = 400;
+	tree->heightMode = MEASURE_EXACTLY;
+	tree->changed = widened;
+	tree->oldWidth = 100;
+	tree->oldHeight = 5;
+	tree->changedAxes = FLEX_DIRTY_WIDTH;
+}
+
+/** Adds a leaf with the content size and, if defined, the same style size in the main axis of its parent. */
+static struct Widget *addFixedLeaf(struct Tree *tree, struct Widget *parent, float size, float contentWidth, float contentHeight) {
+	struct Widget *leaf = addFixedWidget(tree, parent, DIRECTION_ROW, ALIGN_START);
+	*(parent->direction == DIRECTION_ROW ? &leaf->params.width : &leaf->params.height) = size;
+	leaf->leaf = 1;
+	leaf->contentWidth = contentWidth;
+	leaf->contentHeight = contentHeight;
+	return leaf;
+}
+
+/**
+ * A centered row of nested stretched rows, one holding a leaf wider than the row.
+ *
+ * Merging the children of the nested rows into the outer one measured the
+ * wide leaf at the width of the outer row rather than of its own, so it is
+ * merged only if its width is fixed. The other nested rows are merged.
+ */
+static void buildMergedRows(struct Tree *tree) {
+	tree->count = 0;
+	tree->wraps = 1;
+	struct Widget *root = addFixedWidget(tree, NULL, DIRECTION_ROW, ALIGN_START),
+		*overflowing = addFixedWidget(tree, root, DIRECTION_ROW, ALIGN_STRETCH);
+	root->justify = ALIGN_CENTER;
+	addFixedLeaf(tree, overflowing, 30, 30, 10);
+	addFixedLeaf(tree, overflowing, UNDEFINED, 400, 10)->wrap = 1;
+	struct Widget *outer = addFixedWidget(tree, root, DIRECTION_ROW, ALIGN_STRETCH);
+	addFixedLeaf(tree, outer, 20, 20, 10);
+	struct Widget *inner = addFixedWidget(tree, outer, DIRECTION_ROW, ALIGN_STRETCH);
+	addFixedLeaf(tree, inner, 15, 15, 10)->params.align = ALIGN_CENTER;
+	struct Widget *changed = addFixedLeaf(tree, inner, 10, 10, 20);
+	changed->params.marginLeft = 3;
+	addFixedLeaf(tree, root, UNDEFINED, 40, 10)->params.flex = 1;
+	tree->width = 300;
+	tree->widthMode = MEASURE_EXACTLY;
+	tree->height = 40;
+	tree->heightMode = MEASURE_EXACTLY;
+	tree->changed = changed;
+	tree->oldWidth = 10;
+	tree->oldHeight = 30;
+	tree->changedAxes = FLEX_DIRTY_HEIGHT;
+}
+
+/** Builds the trees that reproduce past bugs, which are tested before the random ones. */
+static void (*const fixedTrees[])(struct Tree *tree) = { buildStretchedWrap, buildMergedRows };
+
+/** Swaps the content of the changed leaf between before and after the change. */
+static void toggleChange(struct Tree *tree) {
+	if (!tree->changed) return;
+	float width = tree->changed->contentWidth, height = tree->changed->contentHeight;
+	tree->changed->contentWidth = tree->oldWidth;
+	tree->changed->contentHeight = tree->oldHeight;
+	tree->oldWidth = width;
+	tree->oldHeight = height;
+}
+
+static float fitContent(float content, float available, enum MeasureMode mode) {
+	return mode == MEASURE_EXACTLY || (mode == MEASURE_AT_MOST && content > available) ? available : content;
+}
+
+/** Sizes the leaf to its content, keeping its area if it wraps. */
+static void measureLeaf(const struct Widget *widget, float width, enum MeasureMode widthMode, float height, enum MeasureMode heightMode, float *resultWidth, float *resultHeight) {
+	float contentHeight = widget->contentHeight;
+	*resultWidth = fitContent(widget->contentWidth, width, widthMode);
+	if (widget->wrap && *resultWidth > 0) contentHeight = widget->contentWidth * widget->contentHeight / *resultWidth;
+	*resultHeight = fitContent(contentHeight, height, heightMode);
+}
+
+static void widgetSetX(const void *widget, float x) { ((struct Widget *) widget)->x = x; }
+static void widgetSetY(const void *widget, float y) { ((struct Widget *) widget)->y = y; }
+static float widgetGetWidth(const void *widget) { return ((const struct Widget *) widget)->width; }
+static void widgetSetWidth(const void *widget, float width) { ((struct Widget *) widget)->width = width; }
+static float widgetGetHeight(const void *widget) { return ((const struct Widget *) widget)->height; }
+static void widgetSetHeight(const void *widget, float height) { ((struct Widget *) widget)->height = height; }
+static int widgetGetChildCount(const void *widget) { return ((const struct Widget *) widget)->childCount; }
+static void *widgetGetChildAt(const void *widget, int index) { return ((const struct Widget *) widget)->children[index]; }
+static void *widgetGetLayoutParams(const void *widget) { return ((const struct Widget *) widget)->layoutParams; }
+static struct FlexState *widgetGetState(const void *widget) { return &((struct Widget *) widget)->state; }
+
+static unsigned long long widgetGetContentHash(const void *data) {
+	const struct Widget *widget = data;
+	unsigned bits[2];
+	if (!widget->leaf) return 0;
+	memcpy(bits, &widget->contentWidth, sizeof *bits);
+	memcpy(bits + 1, &widget->contentHeight, sizeof *bits);
+	// Whether the content wraps changes its size as well
+	return (((unsigned long long) bits[0] << 32 | bits[1]) * 0x9E3779B97F4A7C15ULL ^ (unsigned long long) widget->wrap << 1) | 1;
+}
+
+static void widgetLayout(const void *data, float width, enum MeasureMode widthMode, float height, enum MeasureMode heightMode) {
+	struct Widget *widget = (struct Widget *) data;
+	if (widget->leaf) {
+		measureLeaf(widget, width, widthMode, height, heightMode, &widget->width, &widget->height);
+	} else {
+		layoutFlex(flexCurrentContext(), widget, width, widthMode, height, heightMode, widget->direction, widget->justify);
+	}
+}
+
+static const struct FlexContext widgetContext = {
+	.setX = widgetSetX,
+	.setY = widgetSetY,
+	.getWidth = widgetGetWidth,
+	.setWidth = widgetSetWidth,
+	.getHeight = widgetGetHeight,
+	.setHeight = widgetSetHeight,
+	.layout = widgetLayout,
+	.getChildCount = widgetGetChildCount,
+	.getChildAt = widgetGetChildAt,
+	.getLayoutParams = widgetGetLayoutParams
+};
+
+/** Returns a NaN that no layout computes. */
+static float getSentinel(void) {
+	unsigned bits = 0x7fc0dead;
+	float sentinel;
+	memcpy(&sentinel, &bits, sizeof sentinel);
+	return sentinel;
+}
+
+/** Overwrites the layout of the widgets, other than the position of the root that its caller sets. */
+static void poisonWidgets(struct Tree *tree) {
+	for (int i = 0; i < tree->count; ++i) {
+		struct Widget *widget = tree->widgets + i;
+		widget->x = widget->y = widget->width = widget->height = getSentinel();
+	}
+	tree->widgets[0].x = tree->widgets[0].y = 0;
+}
+
+static void layoutWidgets(const struct FlexContext *context, struct Tree *tree) {
+	struct Widget *root = tree->widgets;
+	layoutFlex(context, root, tree->width, tree->widthMode, tree->height, tree->heightMode, root->direction, root->justify);
+}
+
+static void snapshotWidgets(const struct Tree *tree, float *results) {
+	for (int i = 0; i < tree->count; ++i) {
+		const struct Widget *widget = tree->widgets + i;
+		results[4 * i] = widget->x;
+		results[4 * i + 1] = widget->y;
+		results[4 * i + 2] = widget->width;
+		results[4 * i + 3] = widget->height;
+	}
+}
+
+static void resetStates(struct Tree *tree) {
+	for (int i = 0; i < tree->count; ++i) memset(&tree->widgets[i].state, 0, sizeof tree->widgets[i].state);
+}
+
+/** Marks the changed leaf and its ancestors dirty, as an application must for cached layouts. */
+static void markChange(const struct FlexContext *context, struct Tree *tree) {
+	if (!tree->changed) return;
+	flexMarkDirty(context, tree->changed, tree->changedAxes);
+	for (struct Widget *widget = tree->changed->parent; widget; widget = widget->parent) flexMarkDirty(context, widget, FLEX_DIRTY);
+}
+
+/**
+ * Lays out the tree as it was before the change, twice to fill and to use the caches, and then as it is.
+ *
+ * Only the first layout starts from poisoned results, as widgets whose
+ * layout is cached keep the layout of their descendants.
+ */
+static void layoutChanged(const struct FlexContext *context, struct Tree *tree, float *results) {
+	toggleChange(tree);
+	poisonWidgets(tree);
+	layoutWidgets(context, tree);
+	layoutWidgets(context, tree);
+	toggleChange(tree);
+	markChange(context, tree);
+	layoutWidgets(context, tree);
+	snapshotWidgets(tree, results);
+}
+
+static int runScratch(struct Tree *tree, float *results) {
+	struct FlexContext context = widgetContext;
+	struct FlexScratch scratch;
+	flexScratchInit(&scratch);
+	context.scratch = &scratch;
+	poisonWidgets(tree);
+	layoutWidgets(&context, tree);
+	snapshotWidgets(tree, results);
+	flexScratchDestroy(&scratch);
+	return 1;
+}
+
+/** Defers the task until it is waited for, so that the children are laid out out of order. */
+static void *spawnTask(void *userData, struct FlexTask *task) {
+	(void) userData;
+	return task;
+}
+
+static void waitTask(void *userData, void *handle) {
+	(void) userData;
+	flexRunTask(handle, NULL);
+}
+
+static int runScheduler(struct Tree *tree, float *results) {
+	static const struct FlexScheduler scheduler = { NULL, spawnTask, waitTask, 0 };
+	struct FlexContext context = widgetContext;
+	struct FlexScratch scratch;
+	flexScratchInit(&scratch);
+	context.scratch = &scratch;
+	context.scheduler = &scheduler;
+	poisonWidgets(tree);
+	layoutWidgets(&context, tree);
+	snapshotWidgets(tree, results);
+	flexScratchDestroy(&scratch);
+	return 1;
+}
+
+static int runCache(struct Tree *tree, float *results) {
+	struct FlexContext context = widgetContext;
+	context.getState = widgetGetState;
+	context.options = FLEX_OPTION_CACHE;
+	resetStates(tree);
+	layoutChanged(&context, tree, results);
+	return 1;
+}
+
+static int runStateTable(struct Tree *tree, float *results) {
+	struct FlexContext context = widgetContext;
+	struct FlexTable table;
+	flexTableInit(&table, sizeof(struct FlexState));
+	context.stateTable = &table;
+	context.options = FLEX_OPTION_CACHE;
+	layoutChanged(&context, tree, results);
+	flexTableDestroy(&table);
+	return 1;
+}
+
+static int runMeasureCache(struct Tree *tree, float *results) {
+	struct FlexContext context = widgetContext;
+	struct FlexMeasureCache cache;
+	if (!flexMeasureCacheInit(&cache, 64, 4)) return 0;
+	context.getContentHash = widgetGetContentHash;
+	context.measureCache = &cache;
+	layoutChanged(&context, tree, results);
+	flexMeasureCacheDestroy(&cache);
+	return 1;
+}
+
+static int runInterned(struct Tree *tree, float *results) {
+	struct FlexContext context = widgetContext;
+	struct FlexParamsPool pool;
+	int success = 1;
+	flexParamsPoolInit(&pool);
+	for (int i = 0; i < tree->count && success; ++i) {
+		struct Widget *widget = tree->widgets + i;
+		success = !!(widget->layoutParams = flexParamsIntern(&pool, &widget->params));
+	}
+	context.options = FLEX_OPTION_INTERNED_PARAMS;
+	if (success) {
+		poisonWidgets(tree);
+		layoutWidgets(&context, tree);
+		snapshotWidgets(tree, results);
+	}
+	for (int i = 0; i < tree->count; ++i) tree->widgets[i].layoutParams = &tree->widgets[i].params;
+	flexParamsPoolDestroy(&pool);
+	return success;
+}
+
+static void measureContent(struct FlexNode *node, float width, enum MeasureMode widthMode, float height, enum MeasureMode heightMode) {
+	measureLeaf(node->userData, width, widthMode, height, heightMode, &node->width, &node->height);
+}
+
+/** Copies the tree into nodes, in the same order, whose leaves measure to the content of the widgets. */
+static int createNodes(const struct Tree *tree, struct FlexNode *nodes) {
+	int success = 1;
+	for (int i = 0; i < tree->count; ++i) {
+		const struct Widget *widget = tree->widgets + i;
+		struct FlexNode *node = nodes + i;
+		flexNodeInit(node);
+		node->params = widget->params;
+		node->direction = widget->direction;
+		node->justify = widget->justify;
+		node->userData = (void *) widget;
+		if (widget->leaf) node->measure = measureContent;
+		if (widget->parent) {
+			struct FlexNode *parent = nodes + (widget->parent - tree->widgets);
+			success &= flexNodeInsertChild(parent, node, parent->childCount);
+		}
+	}
+	return success;
+}
+
+static void destroyNodes(const struct Tree *tree, struct FlexNode *nodes) {
+	for (int i = tree->count; i--;) flexNodeDestroy(nodes + i);
+}
+
+static void layoutNodes(const struct FlexContext *context, const struct Tree *tree, struct FlexNode *nodes) {
+	flexNodeLayout(context, nodes, tree->width, tree->widthMode, tree->height, tree->heightMode);
+	nodes->x = nodes->y = 0;
+}
+
+static void snapshotNodes(const struct Tree *tree, const struct FlexNode *nodes, float *results) {
+	for (int i = 0; i < tree->count; ++i) {
+		results[4 * i] = nodes[i].x;
+		results[4 * i + 1] = nodes[i].y;
+		results[4 * i + 2] = nodes[i].width;
+		results[4 * i + 3] = nodes[i].height;
+	}
+}
+
+/** Lays out the tree with #flexNodeLayout and the options, caching layouts from before the change. */
+static int runNodes(struct Tree *tree, float *results, unsigned options) {
+	static struct FlexNode nodes[MAX_NODES];
+	struct FlexContext context = flexNodeContext;
+	context.options = FLEX_OPTION_CACHE | options;
+	int success = createNodes(tree, nodes);
+	if (success) {
+		toggleChange(tree);
+		for (int i = 0; i < tree->count; ++i) nodes[i].x = nodes[i].y = nodes[i].width = nodes[i].height = getSentinel();
+		layoutNodes(&context, tree, nodes);
+		layoutNodes(&context, tree, nodes);
+		toggleChange(tree);
+		if (tree->changed) flexNodeMarkDirty(nodes + (tree->changed - tree->widgets), tree->changedAxes);
+		layoutNodes(&context, tree, nodes);
+		snapshotNodes(tree, nodes, results);
+	}
+	destroyNodes(tree, nodes);
+	return success;
+}
+
+static int runNode(struct Tree *tree, float *results) {
+	return runNodes(tree, results, 0);
+}
+
+static int runMerge(struct Tree *tree, float *results) {
+	return runNodes(tree, results, FLEX_OPTION_MERGE_NESTED);
+}
+
+/** Compares the layout of trees of the batch other than the first with plain layouts of the tree with their content. */
+static int checkBatch(struct Tree *tree, const struct FlexBatch *batch) {
+	float *results = malloc(4 * tree->count * sizeof *results);
+	int match = !!results;
+	for (int t = 1; t < BATCH_TREE_COUNT && match; ++t) {
+		float *contents = malloc(2 * tree->count * sizeof *contents);
+		if (!contents) {
+			match = 0;
+			break;
+		}
+		for (int i = 0; i < tree->count; ++i) {
+			contents[2 * i] = tree->widgets[i].contentWidth;
+			contents[2 * i + 1] = tree->widgets[i].contentHeight;
+			tree->widgets[i].contentWidth = batch->contentWidth[i * BATCH_TREE_COUNT + t];
+			tree->widgets[i].contentHeight = batch->contentHeight[i * BATCH_TREE_COUNT + t];
+		}
+		poisonWidgets(tree);
+		layoutWidgets(&widgetContext, tree);
+		snapshotWidgets(tree, results);
+		for (int i = 0; i < tree->count && match; ++i) {
+			float actual[4] = { batch->x[i * BATCH_TREE_COUNT + t], batch->y[i * BATCH_TREE_COUNT + t],
+				batch->width[i * BATCH_TREE_COUNT + t], batch->height[i * BATCH_TREE_COUNT + t] };
+			if (memcmp(actual, results + 4 * i, sizeof actual)) {
+				fprintf(stderr, "batch: Tree %d of the batch differs at widget %d\n", t, i);
+				match = 0;
+			}
+		}
+		for (int i = 0; i < tree->count; ++i) {
+			tree->widgets[i].contentWidth = contents[2 * i];
+			tree->widgets[i].contentHeight = contents[2 * i + 1];
+		}
+		free(contents);
+	}
+	free(results);
+	return match;
+}
+
+/** Lays out the tree with others of its shape and different content in a #FlexBatch. */
+static int runBatch(struct Tree *tree, float *results) {
+	static struct FlexNode nodes[MAX_NODES];
+	struct FlexBatch batch;
+	float width[BATCH_TREE_COUNT], height[BATCH_TREE_COUNT];
+	int success = createNodes(tree, nodes) && flexBatchInit(&batch, nodes, BATCH_TREE_COUNT);
+	destroyNodes(tree, nodes);
+	if (!success) return 0;
+	for (int i = 0; i < tree->count; ++i) {
+		const struct Widget *widget = tree->widgets + i;
+		for (int t = 0; t < BATCH_TREE_COUNT; ++t) {
+			batch.contentWidth[i * BATCH_TREE_COUNT + t] = t ? randomContentSize(80) : widget->contentWidth;
+			batch.contentHeight[i * BATCH_TREE_COUNT + t] = t ? randomContentSize(40) : widget->contentHeight;
+		}
+	}
+	for (int t = 0; t < BATCH_TREE_COUNT; ++t) {
+		width[t] = tree->width;
+		height[t] = tree->height;
+	}
+	flexBatchLayout(&batch, width, tree->widthMode, height, tree->heightMode);
+	for (int i = 0; i < tree->count; ++i) {
+		results[4 * i] = batch.x[i * BATCH_TREE_COUNT];
+		results[4 * i + 1] = batch.y[i * BATCH_TREE_COUNT];
+		results[4 * i + 2] = batch.width[i * BATCH_TREE_COUNT];
+		results[4 * i + 3] = batch.height[i * BATCH_TREE_COUNT];
+	}
+	success = checkBatch(tree, &batch);
+	flexBatchDestroy(&batch);
+	return success;
+}
+
+static void pushContent(struct FlexPipeline *pipeline, const struct Tree *tree, const struct Widget *widget) {
+	struct FlexMutation mutation = { .type = FLEX_MUTATION_SET_CONTENT };
+	mutation.node = widget - tree->widgets;
+	mutation.width = widget->contentWidth;
+	mutation.height = widget->contentHeight;
+	flexPipelinePush(pipeline, &mutation);
+}
+
+/** Builds the tree as it was before the change in a frame of a #FlexPipeline, and changes it in the next. */
+static int runPipeline(struct Tree *tree, float *results) {
+	struct FlexPipeline pipeline;
+	flexPipelineInit(&pipeline);
+	toggleChange(tree);
+	for (int i = 0; i < tree->count; ++i) {
+		const struct Widget *widget = tree->widgets + i;
+		struct FlexMutation mutation = { .type = FLEX_MUTATION_CREATE };
+		mutation.node = i;
+		flexPipelinePush(&pipeline, &mutation);
+		mutation.type = FLEX_MUTATION_SET_PARAMS;
+		mutation.params = widget->params;
+		flexPipelinePush(&pipeline, &mutation);
+		if (widget->leaf) {
+			pushContent(&pipeline, tree, widget);
+		} else {
+			mutation.type = FLEX_MUTATION_SET_CONTAINER;
+			mutation.direction = widget->direction;
+			mutation.justify = widget->justify;
+			flexPipelinePush(&pipeline, &mutation);
+		}
+		if (widget->parent) {
+			mutation.type = FLEX_MUTATION_INSERT_CHILD;
+			mutation.node = widget->parent - tree->widgets;
+			mutation.child = i;
+			mutation.index = widget->parent->childCount; // Clamped, appending the child
+			flexPipelinePush(&pipeline, &mutation);
+		}
+	}
+	struct FlexMutation root = { .type = FLEX_MUTATION_SET_ROOT };
+	root.width = tree->width;
+	root.widthMode = tree->widthMode;
+	root.height = tree->height;
+	root.heightMode = tree->heightMode;
+	flexPipelinePush(&pipeline, &root);
+	int success = flexPipelineSubmit(&pipeline) && flexPipelineStep(&pipeline);
+	toggleChange(tree);
+	if (tree->changed) pushContent(&pipeline, tree, tree->changed);
+	success = success && flexPipelineSubmit(&pipeline) && flexPipelineStep(&pipeline);
+
+	const struct FlexPipelineResults *frame = flexPipelineAcquire(&pipeline);
+	success = success && !frame->failed && frame->frame == 2 && frame->nodeCount >= tree->count;
+	for (int i = 0; i < tree->count && success; ++i) {
+		results[4 * i] = frame->x[i];
+		results[4 * i + 1] = frame->y[i];
+		results[4 * i + 2] = frame->width[i];
+		results[4 * i + 3] = frame->height[i];
+	}
+	flexPipelineDestroy(&pipeline);
+	return success;
+}
+
+/** A way of laying out a tree that must match plain layout. */
+struct Variant {
+	const char *name;
+	/** Lays out the tree and stores the layout of the widgets in preorder, returning whether it succeeded. */
+	int (*run)(struct Tree *tree, float *results);
+	/** Whether the variant sizes leaves to their content itself, so that it cannot lay out trees that wrap. */
+	int ownLeaves;
+};
+
+static const struct Variant variants[] = {
+	{ "scratch", runScratch, 0 },
+	{ "scheduler", runScheduler, 0 },
+	{ "cache", runCache, 0 },
+	{ "stateTable", runStateTable, 0 },
+	{ "measureCache", runMeasureCache, 0 },
+	{ "interned", runInterned, 0 },
+	{ "node", runNode, 0 },
+	{ "merge", runMerge, 0 },
+	{ "batch", runBatch, 1 },
+	{ "pipeline", runPipeline, 1 }
+};
+
+static const char *const fieldNames[4] = { "x", "y", "width", "height" };
+
+/** Returns whether the results are bitwise equal, reporting the first difference otherwise. */
+static int compare(const struct Tree *tree, const float *expected, const float *actual) {
+	for (int i = 0; i < 4 * tree->count; ++i) {
+		if (!memcmp(expected + i, actual + i, sizeof *actual)) continue;
+		fprintf(stderr, "Widget %d differs: %s is %.9g instead of %.9g\n", i / 4, fieldNames[i % 4], actual[i], expected[i]);
+		return 0;
+	}
+	return 1;
+}
+
+/** Lays out the tree with every variant, returning the number that differ from plain layout. */
+static int test(struct Tree *tree, const char *name) {
+	static float expected[4 * MAX_NODES], actual[4 * MAX_NODES];
+	int failures = 0;
+	poisonWidgets(tree);
+	layoutWidgets(&widgetContext, tree);
+	snapshotWidgets(tree, expected);
+	for (size_t i = 0; i < sizeof variants / sizeof *variants; ++i) {
+		if (variants[i].ownLeaves && tree->wraps) continue;
+		for (int j = 0; j < 4 * tree->count; ++j) actual[j] = getSentinel();
+		if (!variants[i].run(tree, actual) || !compare(tree, expected, actual)) {
+			fprintf(stderr, "%s: Failed on %s\n", variants[i].name, name);
+			++failures;
+		}
+	}
+	return failures;
+}
+
+int main(int argc, char **argv) {
+	int treeCount = 2000;
+	unsigned long long firstSeed = 1;
+	for (int i = 1; i < argc; ++i) {
+		if (!strcmp(argv[i], "--trees") && i + 1 < argc) treeCount = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "--seed") && i + 1 < argc) firstSeed = strtoull(argv[++i], NULL, 10);
+		else {
+			fprintf(stderr, "Usage: %s [--trees N] [--seed N]\n", argv[0]);
+			return 2;
+		}
+	}
+
+	static struct Tree tree;
+	char name[64];
+	int failures = 0;
+	for (size_t i = 0; i < sizeof fixedTrees / sizeof *fixedTrees; ++i) {
+		fixedTrees[i](&tree);
+		snprintf(name, sizeof name, "fixed tree %d", (int) i);
+		failures += test(&tree, name);
+	}
+	for (unsigned long long seed = firstSeed; seed < firstSeed + treeCount; ++seed) {
+		randomState = seed * 0x9e3779b97f4a7c15ULL;
+		if (!randomState) randomState = 1;
+		generateTree(&tree);
+		snprintf(name, sizeof name, "tree %llu", seed);
+		failures += test(&tree, name);
+	}
+	printf("%d trees, %d failures\n", treeCount, failures);
+	return failures != 0;
+}
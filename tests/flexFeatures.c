@@ -0,0 +1,733 @@
+/*
+ * Tests of the behaviour of the features of the library.
+ *
+ * Usage: flexLayout_features [TEST]...
+ *
+ * Runs the named tests, or all of them. Each test lays out small trees of
+ * widgets built by hand and checks the results the feature promises.
+ */
+#include "flexCache.h"
+#include "flexCapture.h"
+#include "flexDebug.h"
+#include "flexTrace.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#endif
+
+/** The greatest number of widgets of the trees of a test. */
+#define MAX_NODES 64
+/** The greatest number of children of a container. */
+#define MAX_CHILDREN 4
+
+#define CHECK(condition) check(condition, #condition, __FILE__, __LINE__)
+
+static int failures;
+
+static void check(int passed, const char *condition, const char *file, int line) {
+	if (passed) return;
+	fprintf(stderr, "%s:%d: check failed: %s\n", file, line, condition);
+	++failures;
+}
+
+/** A thread running a function. */
+struct Thread {
+	void (*run)(void *argument);
+	void *argument;
+#ifdef _WIN32
+	HANDLE handle;
+#else
+	pthread_t handle;
+#endif
+};
+
+#ifdef _WIN32
+static DWORD WINAPI runThread(LPVOID data) {
+	struct Thread *thread = data;
+	thread->run(thread->argument);
+	return 0;
+}
+#else
+static void *runThread(void *data) {
+	struct Thread *thread = data;
+	thread->run(thread->argument);
+	return NULL;
+}
+#endif
+
+/** Starts running the function on a new thread, returning whether it was started. */
+static int startThread(struct Thread *thread, void (*run)(void *argument), void *argument) {
+	thread->run = run;
+	thread->argument = argument;
+#ifdef _WIN32
+	return (thread->handle = CreateThread(NULL, 0, runThread, thread, 0, NULL)) != NULL;
+#else
+	return !pthread_create(&thread->handle, NULL, runThread, thread);
+#endif
+}
+
+/** Waits for the thread to finish. */
+static void joinThread(struct Thread *thread) {
+#ifdef _WIN32
+	WaitForSingleObject(thread->handle, INFINITE);
+	CloseHandle(thread->handle);
+#else
+	pthread_join(thread->handle, NULL);
+#endif
+}
+
+/** A widget of an application without a retained tree of the library. */
+struct Widget {
+	struct FlexParams params;
+	enum FlexDirection direction;
+	enum Align justify;
+	/** Whether the widget is a leaf sized to its content. */
+	int leaf;
+	float contentWidth, contentHeight;
+	struct Widget *parent, *children[MAX_CHILDREN];
+	int childCount;
+	float x, y, width, height;
+	struct FlexState state;
+	/** The number of times the widget was laid out by its parent, or by the test if the root. */
+	int layoutCount;
+	/** The context the widget was last laid out by its parent with. */
+	const struct FlexContext *layoutContext;
+};
+
+static struct Widget widgets[MAX_NODES];
+static int widgetCount;
+
+/** Adds a widget with the default parameters, starting a new tree if \a parent is \c NULL. */
+static struct Widget *addWidget(struct Widget *parent, enum FlexDirection direction) {
+	if (!parent) widgetCount = 0;
+	struct Widget *widget = widgets + widgetCount++;
+	memset(widget, 0, sizeof *widget);
+	widget->params.align = ALIGN_START;
+	widget->params.width = widget->params.height = UNDEFINED;
+	widget->direction = direction;
+	widget->justify = ALIGN_START;
+	widget->parent = parent;
+	if (parent) parent->children[parent->childCount++] = widget;
+	return widget;
+}
+
+static struct Widget *addLeaf(struct Widget *parent, float contentWidth, float contentHeight) {
+	struct Widget *leaf = addWidget(parent, DIRECTION_ROW);
+	leaf->leaf = 1;
+	leaf->contentWidth = contentWidth;
+	leaf->contentHeight = contentHeight;
+	return leaf;
+}
+
+static float fitContent(float content, float available, enum MeasureMode mode) {
+	return mode == MEASURE_EXACTLY || (mode == MEASURE_AT_MOST && content > available) ? available : content;
+}
+
+static float widgetGetX(const void *widget) { return ((const struct Widget *) widget)->x; }
+static float widgetGetY(const void *widget) { return ((const struct Widget *) widget)->y; }
+static void widgetSetX(const void *widget, float x) { ((struct Widget *) widget)->x = x; }
+static void widgetSetY(const void *widget, float y) { ((struct Widget *) widget)->y = y; }
+static float widgetGetWidth(const void *widget) { return ((const struct Widget *) widget)->width; }
+static void widgetSetWidth(const void *widget, float width) { ((struct Widget *) widget)->width = width; }
+static float widgetGetHeight(const void *widget) { return ((const struct Widget *) widget)->height; }
+static void widgetSetHeight(const void *widget, float height) { ((struct Widget *) widget)->height = height; }
+static int widgetGetChildCount(const void *widget) { return ((const struct Widget *) widget)->childCount; }
+static void *widgetGetChildAt(const void *widget, int index) { return ((const struct Widget *) widget)->children[index]; }
+static void *widgetGetLayoutParams(const void *widget) { return &((struct Widget *) widget)->params; }
+
+static void widgetLayout(const void *data, float width, enum MeasureMode widthMode, float height, enum MeasureMode heightMode) {
+	struct Widget *widget = (struct Widget *) data;
+	++widget->layoutCount;
+	widget->layoutContext = flexCurrentContext();
+	if (widget->leaf) {
+		widget->width = fitContent(widget->contentWidth, width, widthMode);
+		widget->height = fitContent(widget->contentHeight, height, heightMode);
+	} else {
+		layoutFlex(flexCurrentContext(), widget, width, widthMode, height, heightMode, widget->direction, widget->justify);
+	}
+}
+
+static struct FlexState *widgetGetState(const void *widget) { return &((struct Widget *) widget)->state; }
+
+static unsigned long long widgetGetContentHash(const void *data) {
+	const struct Widget *widget = data;
+	if (!widget->leaf) return 0;
+	return ((unsigned long long) widget->contentWidth * 1000003 + (unsigned long long) widget->contentHeight) * 0x9E3779B97F4A7C15ULL | 1;
+}
+
+static const struct FlexContext widgetContext = {
+	.getX = widgetGetX,
+	.getY = widgetGetY,
+	.setX = widgetSetX,
+	.setY = widgetSetY,
+	.getWidth = widgetGetWidth,
+	.setWidth = widgetSetWidth,
+	.getHeight = widgetGetHeight,
+	.setHeight = widgetSetHeight,
+	.layout = widgetLayout,
+	.getChildCount = widgetGetChildCount,
+	.getChildAt = widgetGetChildAt,
+	.getLayoutParams = widgetGetLayoutParams
+};
+
+/** Lays out the tree of the root with the constraints, as a parent would. */
+static void layoutRoot(const struct FlexContext *context, struct Widget *root, float width, enum MeasureMode widthMode, float height, enum MeasureMode heightMode) {
+	++root->layoutCount;
+	layoutFlex(context, root, width, widthMode, height, heightMode, root->direction, root->justify);
+}
+
+/** Gives the widgets a layout that no test expects, other than the position of the root that its parent sets. */
+static void poisonWidgets(void) {
+	for (int i = 0; i < widgetCount; ++i) widgets[i].x = widgets[i].y = widgets[i].width = widgets[i].height = -1;
+	widgets[0].x = widgets[0].y = 0;
+}
+
+/** A copy of what layout may change of the widgets. */
+struct Snapshot {
+	float layouts[MAX_NODES][4];
+	struct FlexState states[MAX_NODES];
+};
+
+static void takeSnapshot(struct Snapshot *snapshot) {
+	memset(snapshot, 0, sizeof *snapshot);
+	for (int i = 0; i < widgetCount; ++i) {
+		const struct Widget *widget = widgets + i;
+		snapshot->layouts[i][0] = widget->x;
+		snapshot->layouts[i][1] = widget->y;
+		snapshot->layouts[i][2] = widget->width;
+		snapshot->layouts[i][3] = widget->height;
+		snapshot->states[i] = widget->state;
+	}
+}
+
+static int isUnchanged(const struct Snapshot *snapshot) {
+	struct Snapshot current;
+	takeSnapshot(&current);
+	return !memcmp(&current, snapshot, sizeof current);
+}
+
+static int isCollapsed(const struct Widget *widget) {
+	return !widget->x && !widget->y && !widget->width && !widget->height;
+}
+
+static void testMinSize(void) {
+	struct FlexContext context = widgetContext;
+	context.minSize = 4;
+	struct Widget *root = addWidget(NULL, DIRECTION_ROW), *leaf = addLeaf(root, 30, 12);
+
+	// A long divider is thin in one axis only
+	poisonWidgets();
+	layoutRoot(&context, root, 1000, MEASURE_EXACTLY, 2, MEASURE_EXACTLY);
+	CHECK(leaf->width == 30 && leaf->height == 2);
+	CHECK(root->width == 1000 && root->height == 2);
+
+	poisonWidgets();
+	layoutRoot(&context, root, 3, MEASURE_EXACTLY, 3, MEASURE_EXACTLY);
+	CHECK(isCollapsed(leaf));
+	CHECK(root->width == 3 && root->height == 3);
+
+	// Bounds are as small as exact sizes, but without one the size is that of no children
+	poisonWidgets();
+	layoutRoot(&context, root, 3, MEASURE_AT_MOST, 2, MEASURE_EXACTLY);
+	CHECK(isCollapsed(leaf));
+	CHECK(root->width == 0 && root->height == 2);
+
+	// An unspecified size is not small
+	poisonWidgets();
+	layoutRoot(&context, root, 0, MEASURE_UNSPECIFIED, 3, MEASURE_EXACTLY);
+	CHECK(leaf->width == 30 && leaf->height == 3);
+
+	// A nested container collapses with its descendants, leaving its siblings
+	root = addWidget(NULL, DIRECTION_ROW);
+	struct Widget *panel = addWidget(root, DIRECTION_COLUMN), *sibling = addLeaf(root, 20, 10);
+	struct Widget *row = addWidget(panel, DIRECTION_ROW), *nested = addLeaf(row, 8, 8);
+	panel->params.width = panel->params.height = 2;
+	poisonWidgets();
+	layoutRoot(&context, root, 100, MEASURE_EXACTLY, 100, MEASURE_EXACTLY);
+	CHECK(panel->x == 0 && panel->width == 2 && panel->height == 2);
+	CHECK(isCollapsed(row) && isCollapsed(nested));
+	CHECK(sibling->x == 2 && sibling->width == 20 && sibling->height == 10);
+
+	// Collapsing is off by default
+	context.minSize = 0;
+	poisonWidgets();
+	layoutRoot(&context, root, 100, MEASURE_EXACTLY, 100, MEASURE_EXACTLY);
+	CHECK(row->width == 2 && nested->width == 2 && nested->height == 2);
+}
+
+/** Builds a row of a leaf and a column of two leaves, one flexible. */
+static struct Widget *buildRow(void) {
+	struct Widget *root = addWidget(NULL, DIRECTION_ROW), *column;
+	addLeaf(root, 40, 10)->params.marginLeft = 5;
+	column = addWidget(root, DIRECTION_COLUMN);
+	column->params.align = ALIGN_STRETCH;
+	addLeaf(column, 60, 20);
+	addLeaf(column, 30, 5)->params.flex = 1;
+	return root;
+}
+
+static void testMeasure(void) {
+	struct FlexContext context = widgetContext;
+	struct Widget *root = buildRow();
+	struct Snapshot snapshot;
+	float width, height;
+
+	for (int cache = 0; cache < 2; ++cache) {
+		if (cache) {
+			context.getState = widgetGetState;
+			context.options = FLEX_OPTION_CACHE;
+		}
+		layoutRoot(&context, root, 200, MEASURE_EXACTLY, 100, MEASURE_EXACTLY);
+		takeSnapshot(&snapshot);
+		CHECK(flexMeasure(&context, root, 80, MEASURE_AT_MOST, 0, MEASURE_UNSPECIFIED, &width, &height));
+		CHECK(isUnchanged(&snapshot));
+
+		// The size is the one layout gives
+		layoutRoot(&context, root, 80, MEASURE_AT_MOST, 0, MEASURE_UNSPECIFIED);
+		CHECK(width == root->width && height == root->height);
+		CHECK(width == 105 && height == 25); // The children do not shrink
+
+		// Also when measuring a leaf, which sets its size itself
+		struct Widget *leaf = root->children[0];
+		takeSnapshot(&snapshot);
+		CHECK(flexMeasure(&context, leaf, 15, MEASURE_AT_MOST, 50, MEASURE_EXACTLY, &width, &height));
+		CHECK(width == 15 && height == 50);
+		CHECK(isUnchanged(&snapshot));
+	}
+}
+
+/** Lays out the widget as #widgetLayout, but makes leaves one wider. */
+static void widgetLayoutWider(const void *data, float width, enum MeasureMode widthMode, float height, enum MeasureMode heightMode) {
+	struct Widget *widget = (struct Widget *) data;
+	widgetLayout(data, width, widthMode, height, heightMode);
+	if (widget->leaf) ++widget->width;
+}
+
+static void testVerify(void) {
+	struct FlexContext reference = widgetContext, context = widgetContext;
+	struct FlexDivergence divergence;
+	context.getState = widgetGetState;
+	context.options = FLEX_OPTION_CACHE;
+	struct Widget *root = addWidget(NULL, DIRECTION_ROW), *verified = addWidget(root, DIRECTION_COLUMN), *other = addWidget(root, DIRECTION_COLUMN);
+	struct Widget *leaf = addLeaf(verified, 30, 10);
+	addLeaf(verified, 20, 10);
+	addLeaf(other, 40, 10);
+	layoutRoot(&context, root, 200, MEASURE_EXACTLY, 100, MEASURE_EXACTLY);
+	long epoch = flexGetEpoch();
+
+	// The layouts cached for the verified tree are not used, even if stale
+	leaf->contentWidth = 35;
+	CHECK(flexVerifyLayout(&context, &reference, verified, 100, MEASURE_EXACTLY, 50, MEASURE_EXACTLY, verified->direction, verified->justify, &divergence) == 1);
+	CHECK(leaf->width == 35);
+	// While those of other trees are kept
+	CHECK(flexGetEpoch() == epoch);
+	int layoutCount = other->children[0]->layoutCount;
+	layoutRoot(&context, root, 200, MEASURE_EXACTLY, 100, MEASURE_EXACTLY);
+	CHECK(other->children[0]->layoutCount == layoutCount);
+
+	context.layout = widgetLayoutWider;
+	CHECK(flexVerifyLayout(&context, &reference, verified, 100, MEASURE_EXACTLY, 50, MEASURE_EXACTLY, verified->direction, verified->justify, &divergence) == 0);
+	CHECK(divergence.widget == leaf && divergence.index == 1 && divergence.field == FLEX_FIELD_WIDTH);
+	CHECK(divergence.expected == 35 && divergence.actual == 36);
+}
+
+static void testEpoch(void) {
+	struct FlexContext context = widgetContext;
+	struct Widget *root = buildRow(), *leaf = root->children[0];
+	context.getState = widgetGetState;
+	context.options = FLEX_OPTION_CACHE;
+	layoutRoot(&context, root, 200, MEASURE_EXACTLY, 100, MEASURE_EXACTLY);
+	int layoutCount = leaf->layoutCount;
+	layoutRoot(&context, root, 200, MEASURE_EXACTLY, 100, MEASURE_EXACTLY);
+	CHECK(leaf->layoutCount == layoutCount);
+
+	// A change that is not marked keeps the cached size until all caches are invalidated
+	leaf->contentWidth = 45;
+	layoutRoot(&context, root, 200, MEASURE_EXACTLY, 100, MEASURE_EXACTLY);
+	CHECK(leaf->layoutCount == layoutCount && leaf->width == 40);
+	long epoch = flexGetEpoch();
+	flexInvalidateAll();
+	CHECK(flexGetEpoch() != epoch);
+	layoutRoot(&context, root, 200, MEASURE_EXACTLY, 100, MEASURE_EXACTLY);
+	CHECK(leaf->layoutCount > layoutCount && leaf->width == 45);
+
+	// The measure cache is invalidated as well
+	struct FlexMeasureCache cache;
+	CHECK(flexMeasureCacheInit(&cache, 16, 1));
+	context = widgetContext;
+	context.getContentHash = widgetGetContentHash;
+	context.measureCache = &cache;
+	layoutRoot(&context, root, 200, MEASURE_EXACTLY, 100, MEASURE_EXACTLY);
+	layoutCount = leaf->layoutCount;
+	layoutRoot(&context, root, 200, MEASURE_EXACTLY, 100, MEASURE_EXACTLY);
+	CHECK(leaf->layoutCount == layoutCount);
+	flexInvalidateAll();
+	layoutRoot(&context, root, 200, MEASURE_EXACTLY, 100, MEASURE_EXACTLY);
+	CHECK(leaf->layoutCount > layoutCount);
+	flexMeasureCacheDestroy(&cache);
+}
+
+/** The content of a leaf node, counting its layouts. */
+struct Content {
+	float width, height;
+	int layoutCount;
+};
+
+static void measureContent(struct FlexNode *node, float width, enum MeasureMode widthMode, float height, enum MeasureMode heightMode) {
+	struct Content *content = node->userData;
+	++content->layoutCount;
+	node->width = fitContent(content->width, width, widthMode);
+	node->height = fitContent(content->height, height, heightMode);
+}
+
+static void testDirtyAxis(void) {
+	struct FlexContext context = flexNodeContext;
+	context.options = FLEX_OPTION_CACHE | FLEX_OPTION_STATS;
+	struct FlexNode root, row, leaf, sibling;
+	struct Content content = { 30, 10, 0 }, siblingContent = { 20, 10, 0 };
+	flexNodeInit(&root);
+	flexNodeInit(&row);
+	flexNodeInit(&leaf);
+	flexNodeInit(&sibling);
+	leaf.measure = sibling.measure = measureContent;
+	leaf.userData = &content;
+	sibling.userData = &siblingContent;
+	CHECK(flexNodeInsertChild(&root, &row, 0) && flexNodeInsertChild(&row, &leaf, 0) && flexNodeInsertChild(&root, &sibling, 1));
+	flexNodeLayout(&context, &root, 200, MEASURE_EXACTLY, 100, MEASURE_EXACTLY);
+	CHECK(row.state.layoutCount == 2);
+
+	// Taller content keeps the widths the rows are measured in for their basis
+	content.height = 30;
+	flexNodeMarkDirty(&leaf, FLEX_DIRTY_HEIGHT);
+	CHECK((row.state.flags & FLEX_DIRTY) == FLEX_DIRTY_HEIGHT && (root.state.flags & FLEX_DIRTY) == FLEX_DIRTY_HEIGHT);
+	content.layoutCount = siblingContent.layoutCount = 0;
+	flexNodeLayout(&context, &root, 200, MEASURE_EXACTLY, 100, MEASURE_EXACTLY);
+	CHECK(content.layoutCount == 1 && row.state.layoutCount == 1 && !siblingContent.layoutCount);
+	CHECK(leaf.height == 30 && row.width == 30 && row.height == 30 && sibling.x == 30);
+
+	// Wider content changes the space left to the other items of the row
+	content.width = 50;
+	flexNodeMarkDirty(&leaf, FLEX_DIRTY_WIDTH);
+	CHECK((row.state.flags & FLEX_DIRTY) == FLEX_DIRTY && (root.state.flags & FLEX_DIRTY) == FLEX_DIRTY);
+	flexNodeLayout(&context, &root, 200, MEASURE_EXACTLY, 100, MEASURE_EXACTLY);
+	CHECK(row.width == 50 && sibling.x == 50);
+
+	// In a column, the height of the row is in the main axis
+	root.direction = DIRECTION_COLUMN;
+	flexNodeMarkDirty(&root, FLEX_DIRTY);
+	flexNodeLayout(&context, &root, 200, MEASURE_EXACTLY, 100, MEASURE_EXACTLY);
+	content.height = 20;
+	flexNodeMarkDirty(&leaf, FLEX_DIRTY_HEIGHT);
+	CHECK((row.state.flags & FLEX_DIRTY) == FLEX_DIRTY_HEIGHT && (root.state.flags & FLEX_DIRTY) == FLEX_DIRTY);
+	flexNodeLayout(&context, &root, 200, MEASURE_EXACTLY, 100, MEASURE_EXACTLY);
+	CHECK(row.height == 20 && sibling.y == 20);
+
+	flexNodeDestroy(&sibling);
+	flexNodeDestroy(&leaf);
+	flexNodeDestroy(&row);
+	flexNodeDestroy(&root);
+}
+
+/** Builds a row of a leaf and a nested row of a leaf and another nested row of a leaf, all mergeable, returning the root. */
+static struct FlexNode *buildNestedRows(struct FlexNode *nodes, struct Content *content) {
+	for (int i = 0; i < 6; ++i) {
+		flexNodeInit(nodes + i);
+		nodes[i].params.align = ALIGN_STRETCH;
+		if (i % 2) {
+			nodes[i].measure = measureContent;
+			nodes[i].userData = content;
+			nodes[i].params.width = content->width;
+		}
+	}
+	CHECK(flexNodeInsertChild(nodes, nodes + 1, 0) && flexNodeInsertChild(nodes, nodes + 2, 1)
+		&& flexNodeInsertChild(nodes + 2, nodes + 3, 0) && flexNodeInsertChild(nodes + 2, nodes + 4, 1)
+		&& flexNodeInsertChild(nodes + 4, nodes + 5, 0));
+	return nodes;
+}
+
+/** Returns whether the trees of the nodes are laid out the same. */
+static int isSameNodeLayout(const struct FlexNode *node, const struct FlexNode *other) {
+	if (node->x != other->x || node->y != other->y || node->width != other->width || node->height != other->height
+			|| node->childCount != other->childCount) return 0;
+	for (int i = 0; i < node->childCount; ++i) {
+		if (!isSameNodeLayout(node->children[i], other->children[i])) return 0;
+	}
+	return 1;
+}
+
+static void testMergeNested(void) {
+	struct FlexContext context = flexNodeContext;
+	context.options = FLEX_OPTION_MERGE_NESTED;
+	struct FlexNode merged[6], plain[6];
+	struct Content content = { 30, 10, 0 };
+	buildNestedRows(merged, &content);
+	buildNestedRows(plain, &content);
+	flexNodeLayout(&context, merged, 200, MEASURE_EXACTLY, 50, MEASURE_EXACTLY);
+	flexNodeLayout(&flexNodeContext, plain, 200, MEASURE_EXACTLY, 50, MEASURE_EXACTLY);
+	CHECK(merged[2].mergeable == 1 && merged[2].mergedItemCount == 2);
+	CHECK(isSameNodeLayout(merged, plain));
+	CHECK(merged[5].x == 0 && merged[4].x == 30 && merged[4].height == 50);
+
+	// Marking a change makes the nodes it concerns be checked again
+	merged[4].params.marginLeft = plain[4].params.marginLeft = 5;
+	flexNodeMarkDirty(merged + 4, FLEX_DIRTY);
+	flexNodeMarkDirty(plain + 4, FLEX_DIRTY);
+	flexNodeLayout(&context, merged, 200, MEASURE_EXACTLY, 50, MEASURE_EXACTLY);
+	flexNodeLayout(&flexNodeContext, plain, 200, MEASURE_EXACTLY, 50, MEASURE_EXACTLY);
+	CHECK(!merged[2].mergeable && !merged[4].mergeable);
+	CHECK(isSameNodeLayout(merged, plain));
+	CHECK(merged[4].x == 35);
+
+	for (int i = 6; i--;) {
+		flexNodeDestroy(merged + i);
+		flexNodeDestroy(plain + i);
+	}
+}
+
+/** Returns whether the node and its descendants are laid out as the widget and its descendants. */
+static int isSameLayout(const struct Widget *widget, const struct FlexNode *node) {
+	if (widget->x != node->x || widget->y != node->y || widget->width != node->width || widget->height != node->height
+			|| widget->childCount != node->childCount) return 0;
+	for (int i = 0; i < widget->childCount; ++i) {
+		if (!isSameLayout(widget->children[i], node->children[i])) return 0;
+	}
+	return 1;
+}
+
+static int describeWidget(const void *data, enum FlexDirection *direction, enum Align *justify) {
+	const struct Widget *widget = data;
+	*direction = widget->direction;
+	*justify = widget->justify;
+	return !widget->leaf;
+}
+
+static void testCapture(void) {
+	struct FlexCapture capture;
+	struct Widget *root = buildRow();
+	root->justify = ALIGN_SPACE_BETWEEN;
+	root->children[1]->params.marginTop = 4;
+	FILE *file = tmpfile();
+	CHECK(file != NULL);
+	if (!file) return;
+	layoutRoot(&widgetContext, root, 150, MEASURE_EXACTLY, 60, MEASURE_AT_MOST);
+	CHECK(flexCaptureTree(&widgetContext, root, 150, MEASURE_EXACTLY, 60, MEASURE_AT_MOST, describeWidget, file));
+	// Measuring the intrinsic sizes restored the layout
+	CHECK(root->children[0]->width == 40 && root->children[1]->x == 90);
+
+	rewind(file);
+	int loaded = flexCaptureLoad(&capture, file);
+	fclose(file);
+	CHECK(loaded);
+	if (!loaded) return;
+	CHECK(capture.nodeCount == widgetCount);
+	flexNodeLayout(&flexNodeContext, capture.root, capture.width, capture.widthMode, capture.height, capture.heightMode);
+	CHECK(isSameLayout(root, capture.root));
+	// The shape holds under other constraints too
+	layoutRoot(&widgetContext, root, 80, MEASURE_AT_MOST, 0, MEASURE_UNSPECIFIED);
+	flexNodeLayout(&flexNodeContext, capture.root, 80, MEASURE_AT_MOST, 0, MEASURE_UNSPECIFIED);
+	CHECK(isSameLayout(root, capture.root));
+	flexCaptureDestroy(&capture);
+}
+
+static void testTrace(void) {
+	struct FlexContext recording;
+	struct FlexTrace trace;
+	struct Widget *root = buildRow();
+	root->children[1]->params.marginTop = 4;
+	FILE *file = tmpfile();
+	CHECK(file != NULL);
+	if (!file) return;
+	CHECK(flexTraceBegin(&recording, &widgetContext, file));
+	layoutRoot(&recording, root, 90, MEASURE_EXACTLY, 0, MEASURE_UNSPECIFIED);
+	CHECK(flexTraceEnd());
+
+	// Replaying the trace reproduces the layout without the widgets
+	rewind(file);
+	int loaded = flexTraceLoad(&trace, file);
+	fclose(file);
+	CHECK(loaded);
+	if (!loaded) return;
+	CHECK(trace.nodeCount == widgetCount);
+	CHECK(trace.width == 90 && trace.widthMode == MEASURE_EXACTLY && trace.heightMode == MEASURE_UNSPECIFIED);
+	flexNodeLayout(&flexNodeContext, trace.root, trace.width, trace.widthMode, trace.height, trace.heightMode);
+	CHECK(isSameLayout(root, trace.root));
+	flexTraceDestroy(&trace);
+}
+
+/** The number of threads of the tests of concurrent use. */
+#define THREAD_COUNT 4
+
+/** A thread using a measure cache shared with others. */
+struct CacheUser {
+	struct FlexMeasureCache *cache;
+	unsigned seed;
+	/** The number of lookups, and of those that found a size other than the one stored. */
+	long lookups, errors;
+};
+
+/** Returns the width measured for the content under the constraint, which every thread agrees on. */
+static float getCachedWidth(unsigned long long hash, float width) {
+	return (float) (hash % 97) + width;
+}
+
+static void useCache(void *data) {
+	struct CacheUser *user = data;
+	for (int i = 0; i < 20000; ++i) {
+		user->seed = user->seed * 1103515245u + 12345u;
+		unsigned long long hash = 1 + (user->seed >> 8) % 512;
+		struct FlexMeasurement measurement = { (float) (user->seed >> 20 & 3), MEASURE_AT_MOST, 0, MEASURE_UNSPECIFIED, 0, 0 };
+		++user->lookups;
+		if (flexMeasureCacheFind(user->cache, hash, &measurement)) {
+			if (measurement.resultWidth != getCachedWidth(hash, measurement.width) || measurement.resultHeight != 1) ++user->errors;
+		} else {
+			measurement.resultWidth = getCachedWidth(hash, measurement.width);
+			measurement.resultHeight = 1;
+			flexMeasureCacheStore(user->cache, hash, &measurement);
+		}
+	}
+}
+
+static void testConcurrentCache(void) {
+	struct FlexMeasureCache cache;
+	struct CacheUser users[THREAD_COUNT];
+	struct Thread threads[THREAD_COUNT];
+	long hits, misses, lookups = 0;
+	// Fewer entries than contents and constraints, so that threads evict each other's
+	CHECK(flexMeasureCacheInit(&cache, 256, 4));
+	for (int i = 0; i < THREAD_COUNT; ++i) {
+		users[i].cache = &cache;
+		users[i].seed = i + 1;
+		users[i].lookups = users[i].errors = 0;
+		CHECK(startThread(threads + i, useCache, users + i));
+	}
+	for (int i = 0; i < THREAD_COUNT; ++i) {
+		joinThread(threads + i);
+		CHECK(users[i].errors == 0);
+		lookups += users[i].lookups;
+	}
+	flexMeasureCacheGetStats(&cache, &hits, &misses);
+	CHECK(hits + misses == lookups);
+	CHECK(hits > 0 && misses > 0);
+	flexMeasureCacheDestroy(&cache);
+}
+
+/** A task of #threadScheduler, run on a thread of its own. */
+struct ThreadTask {
+	struct Thread thread;
+	const struct FlexTask *task;
+};
+
+static void runThreadTask(void *data) {
+	struct ThreadTask *threadTask = data;
+	// Nested layout needs a scratch buffer of its own
+	struct FlexContext context = *threadTask->task->context;
+	struct FlexScratch scratch;
+	flexScratchInit(&scratch);
+	context.scratch = &scratch;
+	flexRunTask(threadTask->task, &context);
+	flexScratchDestroy(&scratch);
+}
+
+static void *spawnThread(void *userData, struct FlexTask *task) {
+	(void) userData;
+	struct ThreadTask *threadTask = malloc(sizeof *threadTask);
+	if (threadTask) {
+		threadTask->task = task;
+		if (startThread(&threadTask->thread, runThreadTask, threadTask)) return threadTask;
+		free(threadTask);
+	}
+	flexRunTask(task, NULL);
+	return NULL;
+}
+
+static void waitThread(void *userData, void *handle) {
+	(void) userData;
+	struct ThreadTask *threadTask = handle;
+	joinThread(&threadTask->thread);
+	free(threadTask);
+}
+
+/** Runs every task on a new thread. */
+static const struct FlexScheduler threadScheduler = { NULL, spawnThread, waitThread, 0 };
+
+static void testThreadScheduler(void) {
+	struct Widget *root = addWidget(NULL, DIRECTION_ROW);
+	root->justify = ALIGN_CENTER;
+	for (int i = 0; i < MAX_CHILDREN; ++i) {
+		struct Widget *column = addWidget(root, DIRECTION_COLUMN);
+		column->params.align = i % 2 ? ALIGN_STRETCH : ALIGN_CENTER;
+		column->params.flex = i % 3;
+		for (int j = 0; j < 3; ++j) addLeaf(column, 10 + 7 * i, 5 + 3 * j)->params.flex = j == 1;
+	}
+	struct Snapshot expected;
+	layoutRoot(&widgetContext, root, 300, MEASURE_EXACTLY, 200, MEASURE_AT_MOST);
+	takeSnapshot(&expected);
+
+	struct FlexContext context = widgetContext;
+	struct FlexScratch scratch;
+	flexScratchInit(&scratch);
+	context.scratch = &scratch;
+	context.scheduler = &threadScheduler;
+	for (int cache = 0; cache < 2; ++cache) {
+		if (cache) {
+			for (int i = 0; i < widgetCount; ++i) memset(&widgets[i].state, 0, sizeof widgets[i].state);
+			context.getState = widgetGetState;
+			context.options = FLEX_OPTION_CACHE | FLEX_OPTION_STATS;
+		}
+		for (int i = 0; i < 20; ++i) {
+			// Widgets whose layout is cached keep the layout of their descendants, so only one leaf is laid out anew
+			if (!cache || !i) poisonWidgets();
+			else {
+				for (struct Widget *widget = root->children[i % MAX_CHILDREN]->children[i % 3]; widget; widget = widget->parent) {
+					flexMarkDirty(&context, widget, FLEX_DIRTY);
+				}
+			}
+			layoutRoot(&context, root, 300, MEASURE_EXACTLY, 200, MEASURE_AT_MOST);
+			int same = 1;
+			for (int j = 0; j < widgetCount; ++j) {
+				const struct Widget *widget = widgets + j;
+				const float *layout = expected.layouts[j];
+				same &= widget->x == layout[0] && widget->y == layout[1] && widget->width == layout[2] && widget->height == layout[3];
+			}
+			CHECK(same);
+		}
+		// The grandchildren were laid out on the threads of the tasks
+		CHECK(root->children[0]->children[0]->layoutContext != &context);
+	}
+	flexScratchDestroy(&scratch);
+}
+
+/** A test, which reports failures with #CHECK. */
+struct Test {
+	const char *name;
+	void (*run)(void);
+};
+
+static const struct Test tests[] = {
+	{ "capture", testCapture },
+	{ "concurrentCache", testConcurrentCache },
+	{ "dirtyAxis", testDirtyAxis },
+	{ "epoch", testEpoch },
+	{ "measure", testMeasure },
+	{ "mergeNested", testMergeNested },
+	{ "minSize", testMinSize },
+	{ "threadScheduler", testThreadScheduler },
+	{ "trace", testTrace },
+	{ "verify", testVerify }
+};
+
+int main(int argc, char **argv) {
+	for (size_t i = 0; i < sizeof tests / sizeof *tests; ++i) {
+		int selected = argc == 1;
+		for (int j = 1; j < argc; ++j) selected |= !strcmp(argv[j], tests[i].name);
+		if (!selected) continue;
+		int before = failures;
+		tests[i].run();
+		printf("%s: %s\n", tests[i].name, failures == before ? "passed" : "FAILED");
+	}
+	return failures != 0;
+}
@@ -0,0 +1,544 @@
+/*
+ * Benchmarks layout of synthetic trees and of captured trees.
+ *
+ * Usage: flexLayout_bench [--corpus DIR] [--samples N] [--counters] [--json]
+ *
+ * Each tree is laid out with every engine. With --corpus, the trees are the
+ * captures (files ending in .flex) in DIR instead of the synthetic ones. The
+ * batch engine lays out copies of the tree in lockstep, and is reported per
+ * copy.
+ * With --counters, hardware performance counters are also reported per node
+ * laid out (Linux only).
+ */
+#ifdef __linux__
+#define _GNU_SOURCE
+#else
+#define _POSIX_C_SOURCE 199309L
+#endif
+#include "flexBatch.h"
+#include "flexCapture.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <dirent.h>
+#include <time.h>
+#endif
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+/** The minimum duration of one sample in seconds. */
+#define SAMPLE_TIME 0.005
+/** The number of copies of the tree laid out together by the batch engine. */
+#define BATCH_TREE_COUNT 64
+
+static double getTime(void) {
+#ifdef _WIN32
+	LARGE_INTEGER counter, frequency;
+	QueryPerformanceCounter(&counter);
+	QueryPerformanceFrequency(&frequency);
+	return (double) counter.QuadPart / frequency.QuadPart;
+#else
+	struct timespec time;
+	clock_gettime(CLOCK_MONOTONIC, &time);
+	return time.tv_sec + time.tv_nsec * 1e-9;
+#endif
+}
+
+/** The hardware events counted with --counters. */
+enum Counter {
+	COUNTER_CYCLES,
+	COUNTER_INSTRUCTIONS,
+	COUNTER_CACHE_MISSES,
+	COUNTER_BRANCH_MISSES,
+	COUNTER_COUNT
+};
+
+static const char *counterNames[COUNTER_COUNT] = { "cycles", "instructions", "cache-misses", "branch-misses" };
+
+/** The file descriptors of the open counters, or -1. */
+static int counters[COUNTER_COUNT] = { -1, -1, -1, -1 };
+
+/** Opens the counters for the calling thread, returning whether any are available. */
+static int openCounters(void) {
+#ifdef __linux__
+	static const unsigned long long configs[COUNTER_COUNT] = {
+		PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS, PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES
+	};
+	int available = 0;
+	for (int i = 0; i < COUNTER_COUNT; ++i) {
+		struct perf_event_attr attr;
+		memset(&attr, 0, sizeof attr);
+		attr.size = sizeof attr;
+		attr.type = PERF_TYPE_HARDWARE;
+		attr.config = configs[i];
+		attr.disabled = 1;
+		attr.exclude_kernel = 1;
+		attr.exclude_hv = 1;
+		counters[i] = syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+		available |= counters[i] >= 0;
+	}
+	return available;
+#else
+	return 0;
+#endif
+}
+
+static void closeCounters(void) {
+#ifdef __linux__
+	for (int i = 0; i < COUNTER_COUNT; ++i) {
+		if (counters[i] >= 0) close(counters[i]);
+		counters[i] = -1;
+	}
+#endif
+}
+
+static void startCounters(void) {
+#ifdef __linux__
+	for (int i = 0; i < COUNTER_COUNT; ++i) {
+		if (counters[i] < 0) continue;
+		ioctl(counters[i], PERF_EVENT_IOC_RESET, 0);
+		ioctl(counters[i], PERF_EVENT_IOC_ENABLE, 0);
+	}
+#endif
+}
+
+/** Stops the counters and stores their values, or -1 where unavailable. */
+static void stopCounters(double *values) {
+	for (int i = 0; i < COUNTER_COUNT; ++i) {
+		values[i] = -1;
+#ifdef __linux__
+		unsigned long long value;
+		if (counters[i] < 0) continue;
+		ioctl(counters[i], PERF_EVENT_IOC_DISABLE, 0);
+		if (read(counters[i], &value, sizeof value) == sizeof value) values[i] = value;
+#endif
+	}
+}
+
+/** Options from the command line. */
+struct Options {
+	int sampleCount;
+	int counters;
+	int json;
+};
+
+/** A tree to benchmark. */
+struct Benchmark {
+	char name[256];
+	struct FlexCapture capture;
+};
+
+/** A widget as an application without a retained tree of the library might define it. */
+struct Widget {
+	struct FlexParams params;
+	enum FlexDirection direction;
+	enum Align justify;
+	/** The intrinsic size if the widget is a leaf, otherwise NULL. */
+	const float *intrinsicSize;
+	struct Widget **children;
+	int childCount;
+	float x, y, width, height;
+};
+
+static void widgetSetX(const void *widget, float x) { ((struct Widget *) widget)->x = x; }
+static void widgetSetY(const void *widget, float y) { ((struct Widget *) widget)->y = y; }
+static float widgetGetWidth(const void *widget) { return ((const struct Widget *) widget)->width; }
+static void widgetSetWidth(const void *widget, float width) { ((struct Widget *) widget)->width = width; }
+static float widgetGetHeight(const void *widget) { return ((const struct Widget *) widget)->height; }
+static void widgetSetHeight(const void *widget, float height) { ((struct Widget *) widget)->height = height; }
+static int widgetGetChildCount(const void *widget) { return ((const struct Widget *) widget)->childCount; }
+static void *widgetGetChildAt(const void *widget, int index) { return ((const struct Widget *) widget)->children[index]; }
+static void *widgetGetLayoutParams(const void *widget) { return &((struct Widget *) widget)->params; }
+
+static void widgetLayout(const void *data, float width, enum MeasureMode widthMode, float height, enum MeasureMode heightMode) {
+	struct Widget *widget = (struct Widget *) data;
+	if (widget->intrinsicSize) {
+		widget->width = widthMode == MEASURE_EXACTLY || (widthMode == MEASURE_AT_MOST && widget->intrinsicSize[0] > width) ? width : widget->intrinsicSize[0];
+		widget->height = heightMode == MEASURE_EXACTLY || (heightMode == MEASURE_AT_MOST && widget->intrinsicSize[1] > height) ? height : widget->intrinsicSize[1];
+	} else {
+		layoutFlex(flexCurrentContext(), widget, width, widthMode, height, heightMode, widget->direction, widget->justify);
+	}
+}
+
+static const struct FlexContext widgetContext = {
+	.setX = widgetSetX,
+	.setY = widgetSetY,
+	.getWidth = widgetGetWidth,
+	.setWidth = widgetSetWidth,
+	.getHeight = widgetGetHeight,
+	.setHeight = widgetSetHeight,
+	.layout = widgetLayout,
+	.getChildCount = widgetGetChildCount,
+	.getChildAt = widgetGetChildAt,
+	.getLayoutParams = widgetGetLayoutParams
+};
+
+/** Mirrors the captured tree into widgets, which must have room for all nodes. */
+static struct Widget *createWidgets(const struct FlexCapture *capture, struct Widget *widgets, struct Widget **children) {
+	for (int i = 0; i < capture->nodeCount; ++i) {
+		const struct FlexNode *node = capture->nodes + i;
+		struct Widget *widget = widgets + i;
+		widget->params = node->params;
+		widget->direction = node->direction;
+		widget->justify = node->justify;
+		widget->intrinsicSize = node->measure ? capture->intrinsicSizes + 2 * i : NULL;
+		widget->children = children;
+		widget->childCount = node->childCount;
+		for (int j = 0; j < node->childCount; ++j) *children++ = widgets + (node->children[j] - capture->nodes);
+		widget->x = widget->y = widget->width = widget->height = 0;
+	}
+	return widgets;
+}
+
+/** Copies of the captured tree in a #FlexBatch. */
+struct Batch {
+	struct FlexBatch batch;
+	/** The constraints of each copy. */
+	float width[BATCH_TREE_COUNT], height[BATCH_TREE_COUNT];
+};
+
+/** Initializes the batch with copies of the captured tree, returning whether it has the same nodes. */
+static int createBatch(const struct FlexCapture *capture, struct Batch *batch) {
+	if (!flexBatchInit(&batch->batch, capture->root, BATCH_TREE_COUNT)) return 0;
+	// The leaves of a capture have no children, so both number the nodes the same in preorder
+	if (batch->batch.nodeCount != capture->nodeCount) {
+		flexBatchDestroy(&batch->batch);
+		return 0;
+	}
+	for (int i = 0; i < capture->nodeCount; ++i) {
+		for (int t = 0; t < BATCH_TREE_COUNT; ++t) {
+			batch->batch.contentWidth[i * BATCH_TREE_COUNT + t] = capture->intrinsicSizes[2 * i];
+			batch->batch.contentHeight[i * BATCH_TREE_COUNT + t] = capture->intrinsicSizes[2 * i + 1];
+		}
+	}
+	for (int t = 0; t < BATCH_TREE_COUNT; ++t) {
+		batch->width[t] = capture->width;
+		batch->height[t] = capture->height;
+	}
+	return 1;
+}
+
+/** The ways of laying out a tree that are compared. */
+enum Engine {
+	/** #layoutFlex on the application's own widgets. */
+	ENGINE_CALLBACK,
+	/** #layoutFlex without a scratch buffer, as a context with no options is laid out. */
+	ENGINE_PLAIN,
+	/** The retained #FlexNode tree, which also maintains per-node statistics. */
+	ENGINE_NODE,
+	/** #flexBatchLayout on #BATCH_TREE_COUNT copies of the tree. */
+	ENGINE_BATCH,
+	ENGINE_COUNT
+};
+
+static const char *engineNames[ENGINE_COUNT] = { "callback", "plain", "node", "batch" };
+
+/** The number of copies of the tree each engine lays out per iteration. */
+static const int engineTreeCounts[ENGINE_COUNT] = { 1, 1, 1, BATCH_TREE_COUNT };
+
+/** Lays out the tree of the benchmark \a iterations times with the specified engine. */
+static void run(struct Benchmark *benchmark, enum Engine engine, struct Widget *widgets, struct Batch *batch, struct FlexScratch *scratch, long iterations) {
+	struct FlexCapture *capture = &benchmark->capture;
+	struct FlexContext context = engine == ENGINE_NODE ? flexNodeContext : widgetContext;
+	context.scratch = engine == ENGINE_PLAIN ? NULL : scratch;
+	for (long i = 0; i < iterations; ++i) {
+		switch (engine) {
+			case ENGINE_CALLBACK:
+			case ENGINE_PLAIN:
+				if (widgets->intrinsicSize) widgetLayout(widgets, capture->width, capture->widthMode, capture->height, capture->heightMode);
+				else layoutFlex(&context, widgets, capture->width, capture->widthMode, capture->height, capture->heightMode, widgets->direction, widgets->justify);
+				break;
+			case ENGINE_NODE:
+				flexNodeLayout(&context, capture->root, capture->width, capture->widthMode, capture->height, capture->heightMode);
+				break;
+			case ENGINE_BATCH:
+				flexBatchLayout(&batch->batch, batch->width, capture->widthMode, batch->height, capture->heightMode);
+				break;
+			default:
+				break;
+		}
+	}
+}
+
+/** Prints the string as a JSON string literal. */
+static void printJsonString(const char *string) {
+	putchar('"');
+	for (const unsigned char *c = (const unsigned char *) string; *c; ++c) {
+		if (*c == '"' || *c == '\\') printf("\\%c", *c);
+		else if (*c < 0x20) printf("\\u%04x", *c);
+		else putchar(*c);
+	}
+	putchar('"');
+}
+
+static void printResult(const struct Benchmark *benchmark, enum Engine engine, long iterations, const double *samples, const double *counts, const struct Options *options, int first) {
+	int sampleCount = options->sampleCount, nodeCount = benchmark->capture.nodeCount;
+	double mean = 0, variance = 0;
+	for (int i = 0; i < sampleCount; ++i) mean += samples[i] / sampleCount;
+	for (int i = 0; i < sampleCount; ++i) variance += (samples[i] - mean) * (samples[i] - mean) / (sampleCount > 1 ? sampleCount - 1 : 1);
+
+	if (options->json) {
+		printf("%s\n    {\"name\": ", first ? "" : ",");
+		printJsonString(benchmark->name);
+		printf(", \"engine\": \"%s\", \"nodes\": %d, \"iterations\": %ld, \"mean\": %.3f, \"stddev\": %.3f, \"samples\": [",
+				engineNames[engine], nodeCount, iterations, mean, sqrt(variance));
+		for (int i = 0; i < sampleCount; ++i) printf("%s%.3f", i ? ", " : "", samples[i]);
+		printf("]");
+		if (options->counters) {
+			printf(", \"counters\": {");
+			for (int i = 0, printed = 0; i < COUNTER_COUNT; ++i) {
+				if (counts[i] >= 0) printf("%s\"%s\": %.3f", printed++ ? ", " : "", counterNames[i], counts[i]);
+			}
+			printf("}");
+		}
+		printf("}");
+	} else {
+		printf("%-32s %-10s %8d nodes %12.1f ns/layout (+- %5.1f%%) %8.2f ns/node\n", benchmark->name, engineNames[engine], nodeCount,
+				mean, mean > 0 ? 100 * sqrt(variance) / mean : 0, mean / nodeCount);
+		if (options->counters) {
+			printf("%43s", "per node:");
+			for (int i = 0; i < COUNTER_COUNT; ++i) {
+				if (counts[i] >= 0) printf(" %10.2f %s", counts[i], counterNames[i]);
+			}
+			printf("\n");
+		}
+	}
+}
+
+/** Benchmarks the tree with every engine, printing the time per layout in nanoseconds. */
+static int benchmark(struct Benchmark *benchmark, const struct Options *options, int *first) {
+	struct FlexCapture *capture = &benchmark->capture;
+	struct Widget *widgets = malloc(capture->nodeCount * sizeof *widgets), **children = malloc(capture->nodeCount * sizeof *children);
+	double *samples = malloc(options->sampleCount * sizeof *samples), counts[COUNTER_COUNT];
+	struct Batch *batch = malloc(sizeof *batch);
+	struct FlexScratch scratch;
+	flexScratchInit(&scratch);
+	if (!widgets || !children || !samples || !batch) {
+		free(widgets);
+		free(children);
+		free(samples);
+		free(batch);
+		return 0;
+	}
+	createWidgets(capture, widgets, children);
+	int hasBatch = createBatch(capture, batch);
+
+	for (int engine = 0; engine < ENGINE_COUNT; ++engine) {
+		if (engine == ENGINE_BATCH && !hasBatch) continue;
+		// Calibrate the number of iterations per sample, which also warms up
+		long iterations = 1;
+		for (;;) {
+			double start = getTime();
+			run(benchmark, engine, widgets, batch, &scratch, iterations);
+			if (getTime() - start >= SAMPLE_TIME) break;
+			iterations *= 2;
+		}
+		double layouts = (double) iterations * engineTreeCounts[engine];
+		for (int i = 0; i < options->sampleCount; ++i) {
+			double start = getTime();
+			run(benchmark, engine, widgets, batch, &scratch, iterations);
+			samples[i] = 1e9 * (getTime() - start) / layouts;
+		}
+		if (options->counters) {
+			// Count separately so that the timing is undisturbed
+			startCounters();
+			run(benchmark, engine, widgets, batch, &scratch, iterations);
+			stopCounters(counts);
+			for (int i = 0; i < COUNTER_COUNT; ++i) {
+				if (counts[i] >= 0) counts[i] /= layouts * capture->nodeCount;
+			}
+		}
+		printResult(benchmark, engine, iterations, samples, counts, options, *first);
+		*first = 0;
+	}
+
+	if (hasBatch) flexBatchDestroy(&batch->batch);
+	free(batch);
+	flexScratchDestroy(&scratch);
+	free(widgets);
+	free(children);
+	free(samples);
+	return 1;
+}
+
+/** Loads the capture written to a temporary file from the specified tree. */
+static int loadSynthetic(struct Benchmark *benchmark, const char *name, struct FlexNode *root, float width, float height) {
+	FILE *file = tmpfile();
+	if (!file) return 0;
+	strcpy(benchmark->name, name);
+	int success = flexCaptureTree(&flexNodeContext, root, width, MEASURE_EXACTLY, height, MEASURE_EXACTLY, flexNodeDescribe, file);
+	rewind(file);
+	success = success && flexCaptureLoad(&benchmark->capture, file);
+	fclose(file);
+	return success;
+}
+
+static void measureLabel(struct FlexNode *node, float width, enum MeasureMode widthMode, float height, enum MeasureMode heightMode) {
+	const float *size = node->userData;
+	node->width = widthMode == MEASURE_EXACTLY || (widthMode == MEASURE_AT_MOST && size[0] > width) ? width : size[0];
+	node->height = heightMode == MEASURE_EXACTLY || (heightMode == MEASURE_AT_MOST && size[1] > height) ? height : size[1];
+}
+
+/** Synthetic trees, built from a pool of nodes. */
+struct Builder {
+	struct FlexNode *nodes;
+	float *sizes;
+	int count;
+};
+
+static struct FlexNode *addNode(struct Builder *builder, struct FlexNode *parent, float width, float height) {
+	struct FlexNode *node = builder->nodes + builder->count;
+	float *size = builder->sizes + 2 * builder->count++;
+	flexNodeInit(node);
+	size[0] = width;
+	size[1] = height;
+	if (width >= 0) {
+		node->measure = measureLabel;
+		node->userData = size;
+	}
+	if (parent) flexNodeInsertChild(parent, node, parent->childCount);
+	return node;
+}
+
+static struct FlexNode *addNested(struct Builder *builder, struct FlexNode *parent, int depth) {
+	struct FlexNode *node = addNode(builder, parent, depth ? -1 : 20 + 7 * (builder->count % 5), 12);
+	node->direction = depth % 2 ? DIRECTION_COLUMN : DIRECTION_ROW;
+	node->params.align = ALIGN_STRETCH;
+	if (depth) {
+		addNested(builder, node, depth - 1);
+		addNested(builder, node, depth - 1);
+	}
+	return node;
+}
+
+/** Frees the children of the nodes of the last tree, to build the next one from the start of the pool. */
+static void resetBuilder(struct Builder *builder) {
+	for (int i = 0; i < builder->count; ++i) free(builder->nodes[i].children);
+	builder->count = 0;
+}
+
+static void destroyBuilder(struct Builder *builder) {
+	resetBuilder(builder);
+	free(builder->nodes);
+	free(builder->sizes);
+}
+
+static int loadSynthetics(struct Benchmark *benchmarks) {
+	struct Builder builder = { malloc(4096 * sizeof *builder.nodes), malloc(2 * 4096 * sizeof *builder.sizes), 0 };
+	int count = 0;
+	if (!builder.nodes || !builder.sizes) {
+		destroyBuilder(&builder);
+		return 0;
+	}
+
+	// A toolbar of fixed and flexible items
+	struct FlexNode *root = addNode(&builder, NULL, -1, 0);
+	for (int i = 0; i < 1000; ++i) addNode(&builder, root, 16 + i % 9, 16)->params.flex = i % 3 - 1;
+	count += loadSynthetic(benchmarks + count, "flat_row_1000", root, 8000, 32);
+
+	// Nested stretched containers, which lay out their children repeatedly
+	resetBuilder(&builder);
+	count += loadSynthetic(benchmarks + count, "nested_stretch_8", addNested(&builder, NULL, 8), 800, 600);
+
+	// A list of rows with an icon and two labels
+	resetBuilder(&builder);
+	root = addNode(&builder, NULL, -1, 0);
+	root->direction = DIRECTION_COLUMN;
+	for (int i = 0; i < 200; ++i) {
+		struct FlexNode *row = addNode(&builder, root, -1, 0);
+		row->params.marginBottom = 2;
+		row->justify = ALIGN_SPACE_BETWEEN;
+		addNode(&builder, row, 16, 16)->params.marginRight = 4;
+		addNode(&builder, row, 40 + i % 60, 14)->params.flex = 1;
+		addNode(&builder, row, 30, 14)->params.align = ALIGN_CENTER;
+	}
+	count += loadSynthetic(benchmarks + count, "list_200x3", root, 400, 4000);
+
+	destroyBuilder(&builder);
+	return count;
+}
+
+/** Loads the captures in the directory, returning the number loaded or -1. */
+static int loadCorpus(struct Benchmark **benchmarks, const char *path) {
+#ifdef _WIN32
+	(void) benchmarks;
+	fprintf(stderr, "%s: Corpus directories are not supported on this platform\n", path);
+	return -1;
+#else
+	DIR *directory = opendir(path);
+	if (!directory) {
+		perror(path);
+		return -1;
+	}
+	int count = 0, capacity = 0;
+	for (struct dirent *entry; (entry = readdir(directory));) {
+		size_t length = strlen(entry->d_name);
+		if (length < 5 || strcmp(entry->d_name + length - 5, ".flex")) continue;
+		if (count == capacity) {
+			capacity = capacity ? 2 * capacity : 16;
+			struct Benchmark *newBenchmarks = realloc(*benchmarks, capacity * sizeof *newBenchmarks);
+			if (!newBenchmarks) break;
+			*benchmarks = newBenchmarks;
+		}
+		struct Benchmark *benchmark = *benchmarks + count;
+		char file[4096];
+		snprintf(file, sizeof file, "%s/%s", path, entry->d_name);
+		snprintf(benchmark->name, sizeof benchmark->name, "%.*s", (int) length - 5, entry->d_name);
+		FILE *stream = fopen(file, "r");
+		if (stream && flexCaptureLoad(&benchmark->capture, stream)) ++count;
+		else fprintf(stderr, "%s: Not a valid capture\n", file);
+		if (stream) fclose(stream);
+	}
+	closedir(directory);
+	return count;
+#endif
+}
+
+int main(int argc, char **argv) {
+	const char *corpus = NULL;
+	struct Options options = { 15, 0, 0 };
+	for (int i = 1; i < argc; ++i) {
+		if (!strcmp(argv[i], "--corpus") && i + 1 < argc) corpus = argv[++i];
+		else if (!strcmp(argv[i], "--samples") && i + 1 < argc) options.sampleCount = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "--counters")) options.counters = 1;
+		else if (!strcmp(argv[i], "--json")) options.json = 1;
+		else {
+			fprintf(stderr, "Usage: %s [--corpus DIR] [--samples N] [--counters] [--json]\n", argv[0]);
+			return 2;
+		}
+	}
+	if (options.sampleCount < 1) options.sampleCount = 1;
+	if (options.counters && !openCounters()) {
+		fprintf(stderr, "Hardware performance counters are not available\n");
+		options.counters = 0;
+	}
+
+	struct Benchmark *benchmarks = NULL;
+	int count;
+	if (corpus) {
+		count = loadCorpus(&benchmarks, corpus);
+	} else {
+		benchmarks = malloc(3 * sizeof *benchmarks);
+		count = benchmarks ? loadSynthetics(benchmarks) : -1;
+	}
+	if (count < 0) return 1;
+
+	int first = 1, success = 1;
+	if (options.json) printf("{\n  \"benchmarks\": [");
+	for (int i = 0; i < count; ++i) {
+		success &= benchmark(benchmarks + i, &options, &first);
+		flexCaptureDestroy(&benchmarks[i].capture);
+	}
+	if (options.json) printf("\n  ]\n}\n");
+	closeCounters();
+	free(benchmarks);
+	return !success;
+}
@@ -0,0 +1,259 @@
+/*
+ * Compares two runs of the benchmark tool.
+ *
+ * Usage: flexLayout_compare BASE NEW [--threshold PERCENT]
+ *
+ * BASE and NEW are the output of flexLayout_bench --json. For each benchmark
+ * in both, the change in mean time is printed with a 95% confidence interval
+ * from Welch's t-test, next to the coefficient of variation of each run as an
+ * estimate of the noise. Changes whose interval lies entirely beyond the
+ * threshold (by default 5%) are flagged, and the exit status is 1 if any of
+ * them are regressions.
+ */
+#include <ctype.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/** The results of a benchmark. */
+struct Result {
+	char name[256];
+	char engine[32];
+	double *samples;
+	int sampleCount;
+};
+
+/** A run of the benchmark tool. */
+struct Run {
+	struct Result *results;
+	int count;
+};
+
+/** A parser of the JSON subset written by the benchmark tool. */
+struct Parser {
+	const char *p;
+};
+
+static void skipSpace(struct Parser *parser) {
+	while (isspace((unsigned char) *parser->p)) ++parser->p;
+}
+
+static int expect(struct Parser *parser, char c) {
+	skipSpace(parser);
+	if (*parser->p != c) return 0;
+	++parser->p;
+	return 1;
+}
+
+/** Reads a string into \a buffer, truncating it to \a size. */
+static int parseString(struct Parser *parser, char *buffer, size_t size) {
+	size_t length = 0;
+	if (!expect(parser, '"')) return 0;
+	for (; *parser->p && *parser->p != '"'; ++parser->p) {
+		if (*parser->p == '\\' && parser->p[1]) ++parser->p;
+		if (length + 1 < size) buffer[length++] = *parser->p;
+	}
+	if (size) buffer[length] = '\0';
+	return expect(parser, '"');
+}
+
+static int parseNumber(struct Parser *parser, double *value) {
+	char *end;
+	skipSpace(parser);
+	*value = strtod(parser->p, &end);
+	if (end == parser->p) return 0;
+	parser->p = end;
+	return 1;
+}
+
+/** Skips over any value. */
+static int skipValue(struct Parser *parser) {
+	double number;
+	skipSpace(parser);
+	switch (*parser->p) {
+	case '"':
+		return parseString(parser, NULL, 0);
+	case '{':
+	case '[': {
+		char close = *parser->p++ == '{' ? '}' : ']';
+		if (expect(parser, close)) return 1;
+		do {
+			if (close == '}' && (!parseString(parser, NULL, 0) || !expect(parser, ':'))) return 0;
+			if (!skipValue(parser)) return 0;
+		} while (expect(parser, ','));
+		return expect(parser, close);
+	}
+	default:
+		if (parseNumber(parser, &number)) return 1;
+		while (isalpha((unsigned char) *parser->p)) ++parser->p;
+		return 1;
+	}
+}
+
+static int parseResult(struct Parser *parser, struct Result *result) {
+	char key[64];
+	memset(result, 0, sizeof *result);
+	if (!expect(parser, '{')) return 0;
+	if (expect(parser, '}')) return 1;
+	do {
+		if (!parseString(parser, key, sizeof key) || !expect(parser, ':')) return 0;
+		if (!strcmp(key, "name")) {
+			if (!parseString(parser, result->name, sizeof result->name)) return 0;
+		} else if (!strcmp(key, "engine")) {
+			if (!parseString(parser, result->engine, sizeof result->engine)) return 0;
+		} else if (!strcmp(key, "samples")) {
+			int capacity = 0;
+			if (!expect(parser, '[')) return 0;
+			if (expect(parser, ']')) continue;
+			do {
+				if (result->sampleCount == capacity) {
+					capacity = capacity ? 2 * capacity : 16;
+					double *samples = realloc(result->samples, capacity * sizeof *samples);
+					if (!samples) return 0;
+					result->samples = samples;
+				}
+				if (!parseNumber(parser, result->samples + result->sampleCount++)) return 0;
+			} while (expect(parser, ','));
+			if (!expect(parser, ']')) return 0;
+		} else if (!skipValue(parser)) return 0;
+	} while (expect(parser, ','));
+	return expect(parser, '}');
+}
+
+static void destroyRun(struct Run *run) {
+	for (int i = 0; i < run->count; ++i) free(run->results[i].samples);
+	free(run->results);
+}
+
+/** Loads the results in the specified file. */
+static int loadRun(struct Run *run, const char *path) {
+	FILE *file = fopen(path, "rb");
+	char *text = NULL, key[64];
+	long length = -1;
+	memset(run, 0, sizeof *run);
+	if (file && !fseek(file, 0, SEEK_END) && (length = ftell(file)) >= 0 && !fseek(file, 0, SEEK_SET) && (text = malloc(length + 1))) {
+		length = (long) fread(text, 1, length, file);
+		text[length] = '\0';
+	}
+	if (file) fclose(file);
+	if (!text) {
+		perror(path);
+		return 0;
+	}
+
+	struct Parser parser = { text };
+	int success = expect(&parser, '{'), capacity = 0;
+	while (success && parseString(&parser, key, sizeof key) && expect(&parser, ':')) {
+		if (strcmp(key, "benchmarks")) {
+			success = skipValue(&parser);
+		} else if ((success = expect(&parser, '[')) && !expect(&parser, ']')) {
+			do {
+				if (run->count == capacity) {
+					capacity = capacity ? 2 * capacity : 16;
+					struct Result *results = realloc(run->results, capacity * sizeof *results);
+					if (!(success = !!results)) break;
+					run->results = results;
+				}
+				success = parseResult(&parser, run->results + run->count);
+				++run->count;
+			} while (success && expect(&parser, ','));
+			success = success && expect(&parser, ']');
+		}
+		if (!expect(&parser, ',')) break;
+	}
+	success = success && expect(&parser, '}');
+	free(text);
+	if (!success) {
+		fprintf(stderr, "%s: Not a valid benchmark result\n", path);
+		destroyRun(run);
+	}
+	return success;
+}
+
+static const struct Result *findResult(const struct Run *run, const struct Result *result) {
+	for (int i = 0; i < run->count; ++i) {
+		if (!strcmp(run->results[i].name, result->name) && !strcmp(run->results[i].engine, result->engine)) return run->results + i;
+	}
+	return NULL;
+}
+
+/** Computes the mean and the sample variance. */
+static void summarize(const struct Result *result, double *mean, double *variance) {
+	int n = result->sampleCount;
+	*mean = *variance = 0;
+	for (int i = 0; i < n; ++i) *mean += result->samples[i] / n;
+	for (int i = 0; i < n; ++i) *variance += (result->samples[i] - *mean) * (result->samples[i] - *mean) / (n > 1 ? n - 1 : 1);
+}
+
+/** Returns the two-sided 95% quantile of Student's t-distribution, by the Cornish-Fisher expansion. */
+static double studentQuantile(double degrees) {
+	const double z = 1.959964;
+	double z3 = z * z * z, z5 = z3 * z * z;
+	return z + (z3 + z) / (4 * degrees) + (5 * z5 + 16 * z3 + 3 * z) / (96 * degrees * degrees);
+}
+
+int main(int argc, char **argv) {
+	const char *paths[2] = { NULL, NULL };
+	double threshold = 5;
+	int pathCount = 0;
+	for (int i = 1; i < argc; ++i) {
+		if (!strcmp(argv[i], "--threshold") && i + 1 < argc) threshold = atof(argv[++i]);
+		else if (pathCount < 2 && strncmp(argv[i], "--", 2)) paths[pathCount++] = argv[i];
+		else pathCount = 3;
+	}
+	if (pathCount != 2) {
+		fprintf(stderr, "Usage: %s BASE NEW [--threshold PERCENT]\n", argv[0]);
+		return 2;
+	}
+	struct Run base, run;
+	if (!loadRun(&base, paths[0])) return 2;
+	if (!loadRun(&run, paths[1])) {
+		destroyRun(&base);
+		return 2;
+	}
+
+	int regressions = 0;
+	printf("%-32s %-10s %12s %12s %8s %20s %7s %7s\n", "benchmark", "engine", "base ns", "new ns", "change", "95% interval", "base cv", "new cv");
+	for (int i = 0; i < run.count; ++i) {
+		const struct Result *result = run.results + i, *baseResult = findResult(&base, result);
+		if (!baseResult) {
+			printf("%-32s %-10s only in %s\n", result->name, result->engine, paths[1]);
+			continue;
+		}
+		if (baseResult->sampleCount < 2 || result->sampleCount < 2) {
+			printf("%-32s %-10s too few samples\n", result->name, result->engine);
+			continue;
+		}
+		double baseMean, baseVariance, mean, variance;
+		summarize(baseResult, &baseMean, &baseVariance);
+		summarize(result, &mean, &variance);
+
+		// Welch's t-test, with the interval relative to the base mean
+		double baseError = baseVariance / baseResult->sampleCount, error = variance / result->sampleCount,
+			   degrees = (baseError + error) * (baseError + error)
+				   / (baseError * baseError / (baseResult->sampleCount - 1) + error * error / (result->sampleCount - 1)),
+			   margin = (degrees > 0 ? studentQuantile(degrees) : 0) * sqrt(baseError + error),
+			   change = 100 * (mean - baseMean) / baseMean, low = 100 * (mean - baseMean - margin) / baseMean,
+			   high = 100 * (mean - baseMean + margin) / baseMean;
+		const char *verdict = "";
+		if (low > threshold) {
+			verdict = "REGRESSION";
+			++regressions;
+		} else if (high < -threshold) {
+			verdict = "improvement";
+		} else if (low > 0 || high < 0) {
+			verdict = "significant";
+		}
+		printf("%-32s %-10s %12.1f %12.1f %+7.1f%% [%+7.1f%%, %+7.1f%%] %6.1f%% %6.1f%% %s\n", result->name, result->engine, baseMean, mean,
+				change, low, high, 100 * sqrt(baseVariance) / baseMean, 100 * sqrt(variance) / mean, verdict);
+	}
+	for (int i = 0; i < base.count; ++i) {
+		if (!findResult(&run, base.results + i)) printf("%-32s %-10s only in %s\n", base.results[i].name, base.results[i].engine, paths[0]);
+	}
+	if (regressions) printf("%d regression%s over %g%%\n", regressions, regressions == 1 ? "" : "s", threshold);
+
+	destroyRun(&base);
+	destroyRun(&run);
+	return !!regressions;
+}
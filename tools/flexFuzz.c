@@ -0,0 +1,280 @@
+/*
+ * Searches for trees that are expensive to lay out.
+ *
+ * Usage: flexLayout_fuzz [--nodes N] [--iterations N] [--restarts N]
+ *        [--seed N] [--time] [--out DIR]
+ *
+ * Random trees are mutated by hill climbing, keeping mutations that do not
+ * lower the number of layout callbacks per node (or with --time, the time
+ * per node). The worst tree of each restart is written to DIR as a capture,
+ * to be added to the corpus of the benchmark tool. Trees needing more than
+ * CALL_BUDGET callbacks per layout are too slow to benchmark, so the search
+ * stays below it; the first such tree of each restart is reported and written
+ * to DIR with the suffix _over, to be investigated separately. A restart that
+ * finds no random tree below the budget to start from is skipped.
+ */
+#include "flexCapture.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/** The number of layout callbacks after which layout stops recursing. */
+#define CALL_BUDGET 100000
+/** The number of random trees tried for one below the budget to start a restart from. */
+#define START_ATTEMPTS 100
+
+/** A node of a tree being mutated. Nodes only have parents before them. */
+struct Gene {
+	/** The index of the parent, or -1 for the root. */
+	int parent;
+	struct FlexParams params;
+	enum FlexDirection direction;
+	enum Align justify;
+	/** The intrinsic size, used if the node has no children. */
+	float intrinsicSize[2];
+};
+
+/** A tree being mutated. */
+struct Genome {
+	struct Gene *genes;
+	int count;
+	enum MeasureMode widthMode, heightMode;
+};
+
+static unsigned long long randomState = 88172645463325252ULL;
+
+static unsigned nextRandom(void) {
+	randomState ^= randomState << 13;
+	randomState ^= randomState >> 7;
+	randomState ^= randomState << 17;
+	return (unsigned) (randomState >> 32);
+}
+
+static int randomInt(int n) {
+	return nextRandom() % n;
+}
+
+static float randomSize(void) {
+	return randomInt(4) ? (float) (1 + randomInt(200)) : UNDEFINED;
+}
+
+static void randomizeGene(struct Gene *gene) {
+	static const enum Align aligns[] = { ALIGN_START, ALIGN_CENTER, ALIGN_END, ALIGN_STRETCH };
+	static const enum Align justifies[] = { ALIGN_START, ALIGN_CENTER, ALIGN_END, ALIGN_SPACE_BETWEEN, ALIGN_SPACE_AROUND };
+	gene->params.align = randomInt(2) ? ALIGN_STRETCH : aligns[randomInt(4)];
+	gene->params.flex = (float) (randomInt(5) - 2);
+	gene->params.width = randomInt(2) ? UNDEFINED : randomSize();
+	gene->params.height = randomInt(2) ? UNDEFINED : randomSize();
+	gene->params.marginTop = gene->params.marginRight = gene->params.marginBottom = gene->params.marginLeft = 0;
+	if (!randomInt(4)) gene->params.marginLeft = gene->params.marginTop = (float) randomInt(8);
+	gene->direction = randomInt(2) ? DIRECTION_ROW : DIRECTION_COLUMN;
+	gene->justify = justifies[randomInt(5)];
+	gene->intrinsicSize[0] = (float) (1 + randomInt(100));
+	gene->intrinsicSize[1] = (float) (1 + randomInt(40));
+}
+
+static void randomizeGenome(struct Genome *genome) {
+	for (int i = 0; i < genome->count; ++i) {
+		randomizeGene(genome->genes + i);
+		genome->genes[i].parent = i ? randomInt(i) : -1;
+	}
+	genome->widthMode = genome->heightMode = MEASURE_EXACTLY;
+}
+
+/** Applies a random mutation to the genome. */
+static void mutate(struct Genome *genome) {
+	static const enum MeasureMode modes[] = { MEASURE_UNSPECIFIED, MEASURE_EXACTLY, MEASURE_AT_MOST };
+	struct Gene *gene = genome->genes + randomInt(genome->count);
+	switch (randomInt(8)) {
+	case 0:
+		gene->direction = gene->direction == DIRECTION_ROW ? DIRECTION_COLUMN : DIRECTION_ROW;
+		break;
+	case 1:
+		gene->params.align = gene->params.align == ALIGN_STRETCH ? ALIGN_START : ALIGN_STRETCH;
+		break;
+	case 2:
+		gene->params.flex = -gene->params.flex + (float) (randomInt(3) - 1);
+		break;
+	case 3:
+		gene->params.width = isUndefined(gene->params.width) ? randomSize() : UNDEFINED;
+		break;
+	case 4:
+		gene->params.height = isUndefined(gene->params.height) ? randomSize() : UNDEFINED;
+		break;
+	case 5:
+		// Move the subtree under another node, keeping parents before children
+		if (gene != genome->genes) gene->parent = randomInt((int) (gene - genome->genes));
+		break;
+	case 6:
+		if (randomInt(2)) genome->widthMode = modes[randomInt(3)];
+		else genome->heightMode = modes[randomInt(3)];
+		break;
+	default:
+		randomizeGene(gene);
+		break;
+	}
+}
+
+static void measureIntrinsic(struct FlexNode *node, float width, enum MeasureMode widthMode, float height, enum MeasureMode heightMode) {
+	const float *intrinsicSize = node->userData;
+	node->width = widthMode == MEASURE_EXACTLY || (widthMode == MEASURE_AT_MOST && intrinsicSize[0] > width) ? width : intrinsicSize[0];
+	node->height = heightMode == MEASURE_EXACTLY || (heightMode == MEASURE_AT_MOST && intrinsicSize[1] > height) ? height : intrinsicSize[1];
+}
+
+/** Builds the tree of the genome into \a nodes, returning the root or \c NULL if out of memory. */
+static struct FlexNode *build(struct Genome *genome, struct FlexNode *nodes) {
+	for (int i = 0; i < genome->count; ++i) {
+		struct Gene *gene = genome->genes + i;
+		flexNodeInit(nodes + i);
+		nodes[i].params = gene->params;
+		nodes[i].direction = gene->direction;
+		nodes[i].justify = gene->justify;
+		if (i && !flexNodeInsertChild(nodes + gene->parent, nodes + i, nodes[gene->parent].childCount)) return NULL;
+	}
+	for (int i = 0; i < genome->count; ++i) {
+		if (nodes[i].childCount) continue;
+		nodes[i].measure = measureIntrinsic;
+		nodes[i].userData = genome->genes[i].intrinsicSize;
+	}
+	return nodes;
+}
+
+static void destroy(struct FlexNode *nodes, int count) {
+	for (int i = 0; i < count; ++i) free(nodes[i].children);
+}
+
+static long callCount;
+
+/** Counts the callback, and stops recursing once over budget so that pathological trees terminate. */
+static void countingLayout(const void *widget, float width, enum MeasureMode widthMode, float height, enum MeasureMode heightMode) {
+	struct FlexNode *node = (struct FlexNode *) widget;
+	if (++callCount > CALL_BUDGET) {
+		node->width = widthMode == MEASURE_UNSPECIFIED ? 0 : width;
+		node->height = heightMode == MEASURE_UNSPECIFIED ? 0 : height;
+		return;
+	}
+	flexNodeLayout(flexCurrentContext(), node, width, widthMode, height, heightMode);
+}
+
+/** Returns the cost per node of laying out the tree of the genome, or -1 if out of memory. */
+static double score(struct Genome *genome, struct FlexNode *nodes, const struct FlexContext *context, int timed, int *overBudget) {
+	struct FlexNode *root = build(genome, nodes);
+	double cost = -1;
+	if (root) {
+		int iterations = 0;
+		clock_t start = clock();
+		callCount = 0;
+		do {
+			flexNodeLayout(context, root, 800, genome->widthMode, 600, genome->heightMode);
+			++iterations;
+		} while (timed && callCount <= CALL_BUDGET && clock() - start < CLOCKS_PER_SEC / 100);
+		*overBudget = callCount > CALL_BUDGET;
+		cost = timed ? 1e9 * (clock() - start) / CLOCKS_PER_SEC / iterations / genome->count : (double) callCount / genome->count;
+	}
+	destroy(nodes, genome->count);
+	return cost;
+}
+
+/** Writes the tree of the genome as a capture. */
+static int save(struct Genome *genome, struct FlexNode *nodes, const char *path) {
+	struct FlexNode *root = build(genome, nodes);
+	FILE *file = root ? fopen(path, "w") : NULL;
+	int success = 0;
+	if (file) {
+		success = flexCaptureTree(&flexNodeContext, root, 800, genome->widthMode, 600, genome->heightMode, flexNodeDescribe, file);
+		success &= !fclose(file);
+	}
+	if (!success) perror(path);
+	destroy(nodes, genome->count);
+	return success;
+}
+
+/** Reports the first tree of the restart found over budget, writing it to \a out unless \c NULL. */
+static int reportOverBudget(struct Genome *genome, struct FlexNode *nodes, const char *out, unsigned long long seed, int restart) {
+	fprintf(stderr, "restart %d: Found a tree needing over %d layout calls\n", restart, CALL_BUDGET);
+	if (!out) return 1;
+	char path[4096];
+	snprintf(path, sizeof path, "%s/fuzz_%llu_%d_over.flex", out, seed, restart);
+	return save(genome, nodes, path);
+}
+
+int main(int argc, char **argv) {
+	int nodeCount = 32, iterations = 2000, restarts = 4, timed = 0;
+	unsigned long long seed = 1;
+	const char *out = NULL;
+	for (int i = 1; i < argc; ++i) {
+		if (!strcmp(argv[i], "--nodes") && i + 1 < argc) nodeCount = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "--iterations") && i + 1 < argc) iterations = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "--restarts") && i + 1 < argc) restarts = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "--seed") && i + 1 < argc) seed = strtoull(argv[++i], NULL, 10);
+		else if (!strcmp(argv[i], "--time")) timed = 1;
+		else if (!strcmp(argv[i], "--out") && i + 1 < argc) out = argv[++i];
+		else {
+			fprintf(stderr, "Usage: %s [--nodes N] [--iterations N] [--restarts N] [--seed N] [--time] [--out DIR]\n", argv[0]);
+			return 2;
+		}
+	}
+	if (nodeCount < 1) nodeCount = 1;
+	randomState ^= seed * 0x9e3779b97f4a7c15ULL;
+	if (!randomState) randomState = 1;
+
+	struct FlexContext context = flexNodeContext;
+	context.layout = countingLayout;
+	struct Genome genome = { malloc(nodeCount * sizeof *genome.genes), nodeCount, MEASURE_EXACTLY, MEASURE_EXACTLY },
+		   best = { malloc(nodeCount * sizeof *best.genes), nodeCount, MEASURE_EXACTLY, MEASURE_EXACTLY };
+	struct FlexNode *nodes = malloc(nodeCount * sizeof *nodes);
+	int success = genome.genes && best.genes && nodes;
+
+	for (int restart = 0; success && restart < restarts; ++restart) {
+		randomizeGenome(&best);
+		int overBudget, reported = 0;
+		double bestScore = score(&best, nodes, &context, timed, &overBudget);
+		if (overBudget) {
+			success = reportOverBudget(&best, nodes, out, seed, restart);
+			reported = 1;
+		}
+		// Start from a tree below the budget, as the tree saved is the best one
+		for (int attempt = 1; success && overBudget && attempt < START_ATTEMPTS; ++attempt) {
+			randomizeGenome(&best);
+			bestScore = score(&best, nodes, &context, timed, &overBudget);
+		}
+		if (success && overBudget) {
+			fprintf(stderr, "restart %d: Found no tree below the budget to start from\n", restart);
+			continue;
+		}
+		for (int i = 0; success && i < iterations && bestScore >= 0; ++i) {
+			memcpy(genome.genes, best.genes, nodeCount * sizeof *genome.genes);
+			genome.widthMode = best.widthMode;
+			genome.heightMode = best.heightMode;
+			for (int mutations = 1 + randomInt(3); mutations--;) mutate(&genome);
+			double genomeScore = score(&genome, nodes, &context, timed, &overBudget);
+			if (overBudget && !reported) {
+				success = reportOverBudget(&genome, nodes, out, seed, restart);
+				reported = 1;
+			}
+			if (overBudget || genomeScore < bestScore) continue;
+			struct Genome swap = best;
+			best = genome;
+			genome = swap;
+			bestScore = genomeScore;
+		}
+		if (!success || bestScore < 0) {
+			success = 0;
+			break;
+		}
+
+		printf("restart %d: %.2f %s per node\n", restart, bestScore, timed ? "ns" : "layout calls");
+		if (out) {
+			char path[4096];
+			snprintf(path, sizeof path, "%s/fuzz_%llu_%d.flex", out, seed, restart);
+			success = save(&best, nodes, path);
+		}
+	}
+
+	if (!success) fprintf(stderr, "Search failed\n");
+	free(genome.genes);
+	free(best.genes);
+	free(nodes);
+	return !success;
+}
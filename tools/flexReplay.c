@@ -0,0 +1,48 @@
+/*
+ * Reruns the layout recorded in a trace, for profiling without the application.
+ *
+ * Usage: flexLayout_replay TRACE [ITERATIONS]
+ */
+#include "flexTrace.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+int main(int argc, char **argv) {
+	if (argc < 2) {
+		fprintf(stderr, "Usage: %s TRACE [ITERATIONS]\n", argv[0]);
+		return 2;
+	}
+	int iterations = argc > 2 ? atoi(argv[2]) : 1000;
+	FILE *file = fopen(argv[1], "rb");
+	if (!file) {
+		perror(argv[1]);
+		return 1;
+	}
+	struct FlexTrace trace;
+	int loaded = flexTraceLoad(&trace, file);
+	fclose(file);
+	if (!loaded) {
+		fprintf(stderr, "%s: Not a valid trace\n", argv[1]);
+		return 1;
+	}
+
+	struct FlexScratch scratch;
+	flexScratchInit(&scratch);
+	struct FlexContext context = flexNodeContext;
+	context.scratch = &scratch;
+
+	clock_t start = clock();
+	for (int i = 0; i < iterations; ++i) {
+		flexNodeLayout(&context, trace.root, trace.width, trace.widthMode, trace.height, trace.heightMode);
+	}
+	double seconds = (double) (clock() - start) / CLOCKS_PER_SEC;
+
+	printf("%d nodes, %d iterations: %.3f us per layout, %.3f ns per node\n", trace.root->state.nodeCount, iterations,
+			1e6 * seconds / iterations, 1e9 * seconds / iterations / trace.root->state.nodeCount);
+	printf("root: %g x %g\n", trace.root->width, trace.root->height);
+
+	flexScratchDestroy(&scratch);
+	flexTraceDestroy(&trace);
+	return 0;
+}